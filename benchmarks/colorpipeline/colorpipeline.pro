@@ -0,0 +1,13 @@
+TEMPLATE = app
+
+TARGET = tst_bench_colorpipeline
+include(../../src/colordebugger.pri)
+RESOURCES += ../../images/images.qrc
+
+SOURCES += tst_bench_colorpipeline.cpp
+
+QT += testlib
+CONFIG += console
+CONFIG -= app_bundle
+OBJECTS_DIR = .obj
+MOC_DIR = .moc
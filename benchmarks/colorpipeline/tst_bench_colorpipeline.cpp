@@ -0,0 +1,398 @@
+#include <QtTest>
+
+#include "colorconvert.h"
+#include "colormatrix.h"
+#include "chromaticitydiagram.h"
+
+// Benchmarks for the color conversion pipeline. Run with
+//
+//     tst_bench_colorpipeline -json results.json
+//
+// to also write the results as JSON, for tracking regressions between
+// builds. The usual QTest options (test function and tag selection,
+// -iterations, -minimumvalue) apply.
+
+Q_DECLARE_METATYPE(RgbColorSpace)
+Q_DECLARE_METATYPE(ColorTransform::Precision)
+
+class tst_ColorPipeline : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void convertImage_data();
+    void convertImage();
+    void convertImageFile_data();
+    void convertImageFile();
+    void convertColor_data();
+    void convertColor();
+    void convertRGBtoYxy_data();
+    void convertRGBtoYxy();
+    void convertYxyToRGB_data();
+    void convertYxyToRGB();
+    void deriveNPM();
+    void createColorSpace_data();
+    void createColorSpace();
+    void chromaticityBackground_data();
+    void chromaticityBackground();
+};
+
+// Smooth gradients with some noise: exercises the whole table range
+// without being as regular as a ramp.
+static QImage testImage(QSize size)
+{
+    QImage image(size, QImage::Format_RGB32);
+    quint32 noise = 1;
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            noise = noise * 1664525 + 1013904223;
+            line[x] = qRgb((x * 255 / size.width() + (noise >> 28)) & 0xff,
+                           (y * 255 / size.height() + (noise >> 24)) & 0xff,
+                           (noise >> 16) & 0xff);
+        }
+    }
+    return image;
+}
+
+static QVector<QRgb> testPixels(int count)
+{
+    const QImage image = testImage(QSize(count, 1));
+    const QRgb *line = reinterpret_cast<const QRgb *>(image.constScanLine(0));
+    QVector<QRgb> pixels(count);
+    std::copy(line, line + count, pixels.begin());
+    return pixels;
+}
+
+static QString pairTag(RgbColorSpace source, RgbColorSpace destination)
+{
+    return colorSpaceName(source) + " -> " + colorSpaceName(destination);
+}
+
+void tst_ColorPipeline::convertImage_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<RgbColorSpace>("source");
+    QTest::addColumn<RgbColorSpace>("destination");
+    QTest::addColumn<ColorTransform::Precision>("precision");
+    QTest::addColumn<int>("threads");
+
+    // Image sizes and precisions, single and multithreaded
+    const QSize sizes[] = { QSize(256, 256), QSize(1024, 1024), QSize(4096, 2048) };
+    const ColorTransform::Precision precisions[] = { ColorTransform::Lookup, ColorTransform::FixedPoint,
+                                                     ColorTransform::Approximate, ColorTransform::Exact };
+    for (QSize size : sizes) {
+        for (ColorTransform::Precision precision : precisions) {
+            for (int threads : { 1, -1 }) {
+                const QString tag = QString("%1x%2 %3 %4 %5 threads").arg(size.width()).arg(size.height())
+                                    .arg(pairTag(sRGB, DisplayP3)).arg(ColorTransform::precisionName(precision))
+                                    .arg(threads == 1 ? QString("1") : QString("all"));
+                QTest::newRow(qPrintable(tag)) << size << sRGB << DisplayP3 << precision << threads;
+            }
+        }
+    }
+
+    // All built-in color space pairs
+    for (int source = 0; source < ColorSpaceCount; ++source) {
+        for (int destination = 0; destination < ColorSpaceCount; ++destination) {
+            const QString tag = "1024x1024 " + pairTag(RgbColorSpace(source), RgbColorSpace(destination));
+            QTest::newRow(qPrintable(tag)) << QSize(1024, 1024) << RgbColorSpace(source)
+                                           << RgbColorSpace(destination) << ColorTransform::Lookup << 1;
+        }
+    }
+}
+
+void tst_ColorPipeline::convertImage()
+{
+    QFETCH(QSize, size);
+    QFETCH(RgbColorSpace, source);
+    QFETCH(RgbColorSpace, destination);
+    QFETCH(ColorTransform::Precision, precision);
+    QFETCH(int, threads);
+
+    QImage image = testImage(size);
+    const QSharedPointer<const ColorTransform> transform =
+        ColorTransform::get(RGBColorSpace(source), RGBColorSpace(destination), ColorTransform::NoFlags, precision);
+
+    QBENCHMARK {
+        transform->apply(&image, threads);
+    }
+}
+
+// The bundled photos, converted from their color space (given by the file
+// name) to sRGB, or from sRGB to Display P3.
+void tst_ColorPipeline::convertImageFile_data()
+{
+    QTest::addColumn<QString>("fileName");
+    QTest::addColumn<RgbColorSpace>("source");
+    QTest::addColumn<RgbColorSpace>("destination");
+
+    const QStringList fileNames = QDir(":/images").entryList(QStringList() << "*.jpg", QDir::Files, QDir::Name);
+    for (const QString &fileName : fileNames) {
+        const QString colorSpaceSuffix = QFileInfo(fileName).completeBaseName().section('-', -1);
+        RgbColorSpace source = sRGB;
+        if (colorSpaceSuffix == "AdobeRGB")
+            source = AdobeRGB;
+        else if (colorSpaceSuffix == "ProPhoto")
+            source = ProPhotoRGB;
+        else if (colorSpaceSuffix == "P3")
+            source = DisplayP3;
+        const RgbColorSpace destination = (source == sRGB) ? DisplayP3 : sRGB;
+        QTest::newRow(qPrintable(fileName)) << fileName << source << destination;
+    }
+}
+
+void tst_ColorPipeline::convertImageFile()
+{
+    QFETCH(QString, fileName);
+    QFETCH(RgbColorSpace, source);
+    QFETCH(RgbColorSpace, destination);
+
+    QImage image = QImage(":/images/" + fileName).convertToFormat(QImage::Format_RGB32);
+    QVERIFY(!image.isNull());
+    const RGBColorSpace sourceColorSpace(source);
+    const RGBColorSpace destinationColorSpace(destination);
+
+    QBENCHMARK {
+        RGBColorSpace::colorConvert(&image, sourceColorSpace, destinationColorSpace);
+    }
+}
+
+static void addColorSpacePairs()
+{
+    QTest::addColumn<RgbColorSpace>("source");
+    QTest::addColumn<RgbColorSpace>("destination");
+    for (int source = 0; source < ColorSpaceCount; ++source) {
+        for (int destination = 0; destination < ColorSpaceCount; ++destination) {
+            QTest::newRow(qPrintable(pairTag(RgbColorSpace(source), RgbColorSpace(destination))))
+                << RgbColorSpace(source) << RgbColorSpace(destination);
+        }
+    }
+}
+
+static void addColorSpaces()
+{
+    QTest::addColumn<RgbColorSpace>("colorSpace");
+    for (int colorSpace = 0; colorSpace < ColorSpaceCount; ++colorSpace)
+        QTest::newRow(qPrintable(colorSpaceName(RgbColorSpace(colorSpace)))) << RgbColorSpace(colorSpace);
+}
+
+// Single colors, as converted for color pickers and the diagram items:
+// 256 colors per iteration.
+void tst_ColorPipeline::convertColor_data()
+{
+    addColorSpacePairs();
+}
+
+void tst_ColorPipeline::convertColor()
+{
+    QFETCH(RgbColorSpace, source);
+    QFETCH(RgbColorSpace, destination);
+
+    const QVector<QRgb> pixels = testPixels(256);
+    const RGBColorSpace sourceColorSpace(source);
+    const RGBColorSpace destinationColorSpace(destination);
+    int checksum = 0;
+
+    QBENCHMARK {
+        for (QRgb pixel : pixels)
+            checksum += RGBColorSpace::colorConvert(QColor(pixel), sourceColorSpace, destinationColorSpace).red();
+    }
+    QVERIFY(checksum >= 0);
+}
+
+// Batches of 64K pixels, to planar float output.
+void tst_ColorPipeline::convertRGBtoYxy_data()
+{
+    addColorSpaces();
+}
+
+void tst_ColorPipeline::convertRGBtoYxy()
+{
+    QFETCH(RgbColorSpace, colorSpace);
+
+    const int count = 64 * 1024;
+    const QVector<QRgb> pixels = testPixels(count);
+    QVector<float> Y(count), x(count), y(count);
+    const RGBColorSpace rgbColorSpace(colorSpace);
+
+    QBENCHMARK {
+        rgbColorSpace.convertRGBtoYxy(pixels.constData(), Y.data(), x.data(), y.data(), count);
+    }
+}
+
+// Batches of 64K colors, as used for the chromaticity diagram fill.
+void tst_ColorPipeline::convertYxyToRGB_data()
+{
+    addColorSpaces();
+}
+
+void tst_ColorPipeline::convertYxyToRGB()
+{
+    QFETCH(RgbColorSpace, colorSpace);
+
+    const int count = 64 * 1024;
+    const RGBColorSpace rgbColorSpace(colorSpace);
+    const QVector<QRgb> pixels = testPixels(count);
+    QVector<float> Yxy(count * 3);
+    rgbColorSpace.convertRGBtoYxy(pixels.constData(), Yxy.data(), count);
+    QVector<QRgb> output(count);
+
+    QBENCHMARK {
+        rgbColorSpace.convertYxyToRGB(Yxy.constData(), output.data(), count);
+    }
+}
+
+// Deriving the RGB -> XYZ matrix from primaries at run time, as for custom
+// color spaces. (The built-in matrices are computed at compile time.)
+void tst_ColorPipeline::deriveNPM()
+{
+    // volatile: keep the compiler from evaluating the call at compile time
+    volatile qreal whiteX = 0.3127;
+    volatile qreal result = 0;
+
+    QBENCHMARK {
+        const Mat3 npm = ::deriveNPM(0.64, 0.33, 0.30, 0.60, 0.15, 0.06, whiteX, 0.3290);
+        result = npm(0, 0);
+    }
+    QVERIFY(result > 0);
+}
+
+// Creating a color space: matrices and transfer function tables.
+void tst_ColorPipeline::createColorSpace_data()
+{
+    addColorSpaces();
+}
+
+void tst_ColorPipeline::createColorSpace()
+{
+    QFETCH(RgbColorSpace, colorSpace);
+
+    QBENCHMARK {
+        RGBColorSpace rgbColorSpace(colorSpace);
+        Q_UNUSED(rgbColorSpace);
+    }
+}
+
+// The full diagram, and zoomed in on the sRGB blue primary, where the fill
+// is computed per pixel.
+void tst_ColorPipeline::chromaticityBackground_data()
+{
+    QTest::addColumn<QSize>("size");
+    QTest::addColumn<qreal>("devicePixelRatio");
+    QTest::addColumn<QRectF>("plotWindow");
+
+    const QSize sizes[] = { QSize(400, 400), QSize(800, 800), QSize(1600, 1600) };
+    const QRectF full(0, 0, 0.8, 0.9);
+    const QRectF zoomed(0.14, 0.05, 0.02, 0.02);
+    for (QSize size : sizes) {
+        for (qreal devicePixelRatio : { 1.0, 2.0 }) {
+            const QString tag = QString("%1x%2 @%3x").arg(size.width()).arg(size.height()).arg(devicePixelRatio);
+            QTest::newRow(qPrintable(tag)) << size << devicePixelRatio << full;
+            QTest::newRow(qPrintable(tag + " zoomed")) << size << devicePixelRatio << zoomed;
+        }
+    }
+}
+
+void tst_ColorPipeline::chromaticityBackground()
+{
+    QFETCH(QSize, size);
+    QFETCH(qreal, devicePixelRatio);
+    QFETCH(QRectF, plotWindow);
+
+    QBENCHMARK {
+        const QImage background = ChromaticityDiagram::renderBackground(size, devicePixelRatio, plotWindow);
+        Q_UNUSED(background);
+    }
+}
+
+// Converts QTest's XML output to JSON:
+//
+//     { "qtVersion": ..., "simdLevel": ..., "idealThreadCount": ...,
+//       "results": [ { "function": ..., "tag": ..., "metric": ...,
+//                      "value": ..., "iterations": ... }, ... ] }
+//
+// value is per iteration, in the unit given by metric (for example
+// WalltimeMilliseconds).
+static bool writeJsonResults(const QString &xmlFileName, const QString &jsonFileName)
+{
+    QFile xmlFile(xmlFileName);
+    if (!xmlFile.open(QIODevice::ReadOnly)) {
+        qWarning("Could not read benchmark results from %s", qPrintable(xmlFileName));
+        return false;
+    }
+
+    QJsonArray results;
+    QString function;
+    QXmlStreamReader xml(&xmlFile);
+    while (!xml.atEnd()) {
+        if (xml.readNext() != QXmlStreamReader::StartElement)
+            continue;
+        const QXmlStreamAttributes attributes = xml.attributes();
+        if (xml.name() == QLatin1String("TestFunction")) {
+            function = attributes.value("name").toString();
+        } else if (xml.name() == QLatin1String("BenchmarkResult")) {
+            QJsonObject result;
+            result["function"] = function;
+            result["tag"] = attributes.value("tag").toString();
+            result["metric"] = attributes.value("metric").toString();
+            result["value"] = attributes.value("value").toDouble();
+            result["iterations"] = attributes.value("iterations").toInt();
+            results.append(result);
+        }
+    }
+    if (xml.hasError()) {
+        qWarning("Could not parse benchmark results: %s", qPrintable(xml.errorString()));
+        return false;
+    }
+
+    QJsonObject root;
+    root["qtVersion"] = QString(qVersion());
+    root["simdLevel"] = simdLevelName(simdLevel());
+    root["idealThreadCount"] = QThread::idealThreadCount();
+    root["results"] = results;
+
+    QFile jsonFile(jsonFileName);
+    if (!jsonFile.open(QIODevice::WriteOnly)) {
+        qWarning("Could not write %s", qPrintable(jsonFileName));
+        return false;
+    }
+    jsonFile.write(QJsonDocument(root).toJson());
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    // No display needed: the diagram background is rendered to a QImage.
+    QCoreApplication app(argc, argv);
+
+    // Take out -json <file>; QTest writes XML to a temporary file instead,
+    // next to the usual text output on stdout.
+    QStringList arguments = app.arguments();
+    QString jsonFileName;
+    const int jsonIndex = arguments.indexOf("-json");
+    if (jsonIndex > 0 && jsonIndex + 1 < arguments.count()) {
+        jsonFileName = arguments.at(jsonIndex + 1);
+        arguments.removeAt(jsonIndex + 1);
+        arguments.removeAt(jsonIndex);
+    }
+
+    QTemporaryFile xmlFile;
+    if (!jsonFileName.isEmpty()) {
+        if (!xmlFile.open()) {
+            qWarning("Could not create a temporary file for the benchmark results");
+            return 1;
+        }
+        xmlFile.close();
+        arguments << "-o" << xmlFile.fileName() + ",xml" << "-o" << "-,txt";
+    }
+
+    tst_ColorPipeline benchmarks;
+    const int result = QTest::qExec(&benchmarks, arguments);
+
+    if (!jsonFileName.isEmpty() && !writeJsonResults(xmlFile.fileName(), jsonFileName))
+        return 1;
+    return result;
+}
+
+#include "tst_bench_colorpipeline.moc"
@@ -1,2 +1,3 @@
 TEMPLATE = subdirs
 wasm: SUBDIRS += examples
+!wasm: SUBDIRS += tools benchmarks tests
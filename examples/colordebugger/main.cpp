@@ -158,17 +158,18 @@ public:
             }
         }
 
-        RGBColorSpace::colorConvert(&m_targetImage, m_sourceColorSpace, m_targetColorSpace);
-
-        QImage displayImage = m_targetImage.copy();
-        RGBColorSpace::colorConvert(&displayImage, m_targetColorSpace, m_displayColorSpace);
+        // Convert source -> target (in place, for sample()) and target -> display,
+        // in one pass over the source pixels.
+        ColorConversionChain chain({ m_sourceColorSpace, m_targetColorSpace, m_displayColorSpace });
+        chain.convert(m_targetImage, { &m_targetImage, &m_displayImage });
 
         QPainter p(this);
-        p.fillRect(rect, displayImage);
+        p.fillRect(rect, m_displayImage);
 
     }
 private:
     QImage m_targetImage;
+    QImage m_displayImage;
     QImage m_sourceImage;
     QLinearGradient m_sourceGradient;
     RGBColorSpace m_sourceColorSpace;
@@ -451,8 +452,9 @@ public:
         samplerConfigLayout->addWidget(new QLabel("Points"));
         QSpinBox *sampleCount = new QSpinBox();
         samplerConfigLayout->addWidget(sampleCount);
-        sampleCount->setValue(m_colorItemCount);
         sampleCount->setMinimum(1);
+        sampleCount->setMaximum(100000);
+        sampleCount->setValue(m_colorItemCount);
 
         samplerConfigLayout->addWidget(new QLabel("Radius"));
         QSpinBox *sampleRadius = new QSpinBox();
@@ -552,46 +554,52 @@ public:
         if (pos.x() < 0 || pos.y() < 0)
             return false;
 
-        // Create color items for the diagram
-        if (m_items.count() != m_colorItemCount) {
-
-            qDeleteAll(m_items);
-            m_items.clear();
-
-            for (int i = 0; i < m_colorItemCount; ++i) {
-                auto item = new ChromaticityColorItem();
-                m_items.append(item);
-                m_chromaticityDiagram->addColorItem(item);
-            }
+        // Create the diagram items: a circle for the cursor sample, and
+        // a point cloud for the samples around it
+        if (m_cursorItem == nullptr) {
+            m_cursorItem = new ChromaticityColorItem();
+            m_chromaticityDiagram->addColorItem(m_cursorItem);
+            m_pointCloudItem = new ChromaticityPointCloudItem();
+            m_chromaticityDiagram->addPointCloudItem(m_pointCloudItem);
         }
 
         // First point: sample at cursor position
         QColor color = m_testWindow->sample(pos);
-        m_items.at(0)->setColor(color, m_colorSpace);
+        m_cursorItem->setColor(color, m_colorSpace);
 
         // Set main color for RGB/XYZ output
         m_chromaticityDiagramWindow->setColor(color, m_colorSpace);
 
-        // Rest of the points: sample around cursor position
-        for (int i = 1; i < m_colorItemCount; ++i) {
-
-            // Square around pos
-            int edgeCount = sqrt(m_colorItemCount - 1);
-            int offsetIndex = i - 1;
-            QPoint offset(-m_sampleRadius + (offsetIndex % edgeCount) * m_sampleRadius *2,
-                          -m_sampleRadius + (offsetIndex / edgeCount) * m_sampleRadius *2);
+        // Rest of the points: sample on a grid over a square around the
+        // cursor position, spanning the sample radius on each side. A single
+        // column or row is centered on the cursor.
+        const int sampleCount = m_colorItemCount - 1;
+        const int columnCount = qMax(1, qCeil(qSqrt(sampleCount)));
+        const int rowCount = qMax(1, (sampleCount + columnCount - 1) / columnCount);
+        const int left = (columnCount > 1) ? -m_sampleRadius : 0;
+        const int top = (rowCount > 1) ? -m_sampleRadius : 0;
+        const qreal columnSpacing = (columnCount > 1) ? m_sampleRadius * 2.0 / (columnCount - 1) : 0;
+        const qreal rowSpacing = (rowCount > 1) ? m_sampleRadius * 2.0 / (rowCount - 1) : 0;
+        m_samples.clear();
+        for (int i = 0; i < sampleCount; ++i) {
+            QPoint offset(left + qRound((i % columnCount) * columnSpacing),
+                          top + qRound((i / columnCount) * rowSpacing));
 
             QPoint itemPos = pos + offset;
             QColor color = m_testWindow->sample(itemPos);
-            m_items.at(i)->setColor(color, m_colorSpace);
+            if (color.isValid())
+                m_samples.append(color.rgb());
         }
+        m_pointCloudItem->setColors(m_samples.constData(), m_samples.count(), m_colorSpace);
 
         return false;
     }
 
     bool filterLeaveEvent(QEvent *) {
-        for (auto item : m_items)
-            item->setVisible(false);
+        if (m_cursorItem)
+            m_cursorItem->setVisible(false);
+        if (m_pointCloudItem)
+            m_pointCloudItem->clear();
 
         m_chromaticityDiagramWindow->setColor(QColor(), m_colorSpace);
 
@@ -606,7 +614,9 @@ private:
 
     int m_colorItemCount;
     int m_sampleRadius;
-    QList<ChromaticityColorItem *> m_items;
+    ChromaticityColorItem *m_cursorItem = nullptr;
+    ChromaticityPointCloudItem *m_pointCloudItem = nullptr;
+    QVector<QRgb> m_samples;
     std::function<void(QVBoxLayout *)> m_addColorSelector;
 };
 
@@ -643,11 +653,6 @@ int main(int argc, char ** argv)
 {
     QApplication app(argc, argv);
 
-    // Tests
-    extern void colorConvertTest();
-    colorConvertTest();
-    //return 0;
-
  //   printPrimaries();
 //    thereAndBackAgain();
  //   printMonochromatic();
@@ -2,17 +2,28 @@
 
 #include "colorconvert.h"
 
+#include <algorithm>
+#include <cmath>
+
 // chromaticitydiagram_data.cpp
 extern int begin_wl;
 extern int end_wl;
 extern int entries;
 extern qreal monochromatic_xy[521][2];
 
-// CIE xy coordinate to QGraphicsScene pos bounded by plotArea.
-QPointF xyToScenePos(QPointF xy, QRectF plotArea, QPointF plotRange)
+// CIE xy coordinate to QGraphicsScene pos bounded by plotArea, which shows
+// the xy coordinates in plotWindow (with y increasing upwards).
+QPointF xyToScenePos(QPointF xy, QRectF plotArea, QRectF plotWindow)
+{
+    return QPointF((xy.x() - plotWindow.left()) / plotWindow.width() * plotArea.width() + plotArea.left(),
+                   (plotWindow.bottom() - xy.y()) / plotWindow.height() * plotArea.height() + plotArea.top());
+}
+
+// The inverse of xyToScenePos()
+QPointF scenePosToXy(QPointF pos, QRectF plotArea, QRectF plotWindow)
 {
-    return QPointF(xy.x() / plotRange.x() * plotArea.width() + plotArea.left(),
-                  ((plotRange.y() - xy.y()) / plotRange.y()) * plotArea.height() + plotArea.top());
+    return QPointF((pos.x() - plotArea.left()) / plotArea.width() * plotWindow.width() + plotWindow.left(),
+                   plotWindow.bottom() - (pos.y() - plotArea.top()) / plotArea.height() * plotWindow.height());
 }
 
 ChromaticityDiagram::ChromaticityDiagram() {
@@ -36,141 +47,267 @@ ChromaticityDiagram::ChromaticityDiagram() {
     m_chart->addSeries(series);
 
     m_axisX = new QValueAxis;
-    m_axisX->setRange(0, m_plotRange.x());
+    m_axisX->setRange(m_plotWindow.left(), m_plotWindow.right());
     m_axisX->setTickCount(9);
     m_axisX->setLabelFormat("%g");
     m_axisX->setTitleText("x");
     m_chart->setAxisX(m_axisX, series);
 
     m_axisY = new QValueAxis;
-    m_axisY->setRange(0, m_plotRange.y());
+    m_axisY->setRange(m_plotWindow.top(), m_plotWindow.bottom());
     m_axisY->setTickCount(10);
     m_axisX->setLabelFormat("%g");
     m_axisY->setTitleText("y");
     m_chart->setAxisY(m_axisY, series);
 
+    // Items on the plot (background and colors) are children of this item,
+    // which clips them to the plot area when zoomed in.
+    m_plotClipItem = new QGraphicsRectItem();
+    m_plotClipItem->setPen(Qt::NoPen);
+    m_plotClipItem->setFlag(QGraphicsItem::ItemClipsChildrenToShape);
+    m_scene->addItem(m_plotClipItem);
+
     // Diagram background (monochromoatic light outline, color
-    // gradient fill) is drawn on a QImage using QPainter, and
-    // displayed on the scene using this pixmap item.
-    QGraphicsPixmapItem *pix = new QGraphicsPixmapItem();
-    m_scene->addItem(pix);
+    // gradient fill), drawn from tiles.
+    m_backgroundItem = new ChromaticityBackgroundItem(m_plotWindowMaximum, m_plotClipItem);
+    m_backgroundItem->setOpacity(0.8);
 
-    // Create monochromatic light "horseshoe" shape from data table
+    // Update diagram background and item positions on resize
+    connect(m_chart, &QChart::plotAreaChanged, [this](const QRectF &){
+        updatePlot();
+    });
+
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setStyleSheet( "QGraphicsView { border-style: none; }" );
+    setRenderHints(QPainter::Antialiasing);
+
+    // Enable zoom on pinch
+    grabGesture(Qt::PinchGesture);
+}
+
+// Monochromatic light "horseshoe" shape, from the data table
+static QPainterPath spectralLocusPath()
+{
     QPainterPath path;
     path.moveTo(monochromatic_xy[0][0], monochromatic_xy[0][1]);
     for (int i = 1; i < entries; i+=1) {
         path.lineTo(monochromatic_xy[i][0], monochromatic_xy[i][1]);
     }
+    return path;
+}
+
+// Calls fn(row, begin, end) for the pixels [begin, end) of each row of an
+// image of imageSize pixels showing plotWindow, which are inside the
+// spectral locus (closed by the line of purples). This is an edge table
+// scanline polygon fill, sampled at pixel centers: edges are sorted by
+// their first row and move through an active edge list, and the crossings
+// with the row are filled in pairs. Only the image rows and columns are
+// visited, so the cost follows the image size and not the zoom level.
+static void forEachSpectralLocusSpan(QSize imageSize, QRectF plotWindow,
+                                     const std::function<void(int row, int begin, int end)> &fn)
+{
+    struct Edge
+    {
+        qreal top;      // first and last row coordinate, top < bottom
+        qreal bottom;
+        qreal x;        // column coordinate at top
+        qreal slope;    // change in x per row
+    };
 
-    // Update diagram background on plot area change.
-    connect(m_chart, &QChart::plotAreaChanged, [this, pix, path](const QRectF &plotArea){
-
-        // Create cache image for drawing the xy plot, filled with transparent pixels
-        QSize imageSize = plotArea.size().toSize();
-        qreal dpr = devicePixelRatioF();
-        QImage xypolot = QImage(imageSize * dpr, QImage::Format_ARGB32_Premultiplied);
-        xypolot.setDevicePixelRatio(dpr);
-        xypolot.fill(QColor(0, 0, 0, 0));
-
-        {
-            // Create painter, scaled to have a logical coordinate system in the
-            // 0..m_plotRange.x()/m_plotRange.y(), with the origin at the bottom right.
-            QPainter p(&xypolot);
-            p.setRenderHint(QPainter::Antialiasing, true);
-            p.scale(imageSize.width() / m_plotRange.x(), imageSize.height() / m_plotRange.y());
-            p.scale(1, -1);
-            p.translate(0, -m_plotRange.y());
-
-            // Draw monochromatic light "horseshoe" outline
-            QPen cosmetic(QColor(50,50,50));
-            cosmetic.setWidth(2);
-            cosmetic.setCosmetic(true);
-            p.strokePath(path, cosmetic);
+    // Edges in image coordinates, where pixel (i, l) is centered at (i + 0.5, l + 0.5)
+    const qreal scaleX = imageSize.width() / plotWindow.width();
+    const qreal scaleY = imageSize.height() / plotWindow.height();
+    auto toImage = [&](int i) {
+        return QPointF((monochromatic_xy[i][0] - plotWindow.left()) * scaleX,
+                       (plotWindow.bottom() - monochromatic_xy[i][1]) * scaleY);
+    };
+    QVector<Edge> edges;
+    edges.reserve(entries);
+    for (int i = 0; i < entries; ++i) {
+        QPointF a = toImage(i);
+        QPointF b = toImage((i + 1) % entries);
+        if (a.y() == b.y())
+            continue; // horizontal edges cross no row centers
+        if (a.y() > b.y())
+            std::swap(a, b);
+        edges.append(Edge{ a.y(), b.y(), a.x(), (b.x() - a.x()) / (b.y() - a.y()) });
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge &a, const Edge &b) { return a.top < b.top; });
+
+    QVector<const Edge *> active;
+    QVector<qreal> crossings;
+    int next = 0;
+    for (int row = 0; row < imageSize.height(); ++row) {
+        const qreal center = row + 0.5;
+
+        // Edges starting at or above this row become active, edges ending
+        // above it retire
+        while (next < edges.count() && edges[next].top <= center)
+            active.append(&edges[next++]);
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [center](const Edge *edge) { return edge->bottom <= center; }),
+                     active.end());
+        if (active.isEmpty())
+            continue;
+
+        crossings.clear();
+        for (const Edge *edge : active)
+            crossings.append(edge->x + (center - edge->top) * edge->slope);
+        std::sort(crossings.begin(), crossings.end());
+
+        for (int i = 0; i + 1 < crossings.count(); i += 2) {
+            // Pixels with centers in [crossings[i], crossings[i + 1])
+            const int begin = qBound(0, int(std::ceil(crossings[i] - 0.5)), imageSize.width());
+            const int end = qBound(0, int(std::ceil(crossings[i + 1] - 0.5)), imageSize.width());
+            if (begin < end)
+                fn(row, begin, end);
         }
-        
-        // A RGB color space that covers approxemately the entire chromaticity chart.
-        RGBColorSpace allColors( (qreal []){0.74, 0.25}, (qreal []){0.05, 0.85}, (qreal []){0.17, 0.0}, 1.0, "allColors");
-
-        // Fill horseshoe interior with color
-        int xypolotHeight = xypolot.height();
-        for (int l = 0; l < xypolotHeight; ++l) {
-            int scanLinePixels = xypolot.bytesPerLine() / 4;
-            QRgb* scanline = (QRgb*)xypolot.scanLine(l);
-
-            bool inside = false;
-            bool online = false;
-            QRgb* begin = nullptr;
-            QRgb* end = nullptr;
-
-            for (int p = 0; p < scanLinePixels; ++p) {
-                QRgb* pixel = scanline + p;
-                bool signal = qBlue(*pixel) > 10;
-
-                // transition to inside on falling edge
-                if (!inside && online && !signal) {
-                    begin = pixel;
-                    inside = true;
-                }
-
-                // transition to outside on rising edge
-                if (inside && !online && signal) {
-                    end = pixel;
-                    break; // only fill once
-                }
-
-                online = signal;
-            }
+    }
+}
 
-            // Don't fill if there was no beginning or no end of area
-            if (begin == nullptr || end == nullptr)
-                continue;
+// A RGB color space that covers approxemately the entire chromaticity chart.
+static RGBColorSpace allColorsColorSpace()
+{
+    return RGBColorSpace((qreal []){0.74, 0.25}, (qreal []){0.05, 0.85}, (qreal []){0.17, 0.0}, 1.0, "allColors");
+}
 
-            // Fill line with RGB color corresponding to the CIE xy coordinate
-            qreal CIE_y = m_plotRange.y() * ((qreal(xypolotHeight) - qreal(l)) / qreal(xypolotHeight));
-            for (QRgb *pixel = begin; pixel <= end; ++pixel) {
-                qreal CIE_Y = 1;
-                qreal CIE_x = m_plotRange.x() * qreal(pixel - scanline) / xypolot.width();
-                QGenericMatrix<1, 3, qreal> Yxy((qreal[]){ CIE_Y, CIE_x, CIE_y });
-                QColor color = allColors.convertYxyToRGB(Yxy);
-                *pixel = color.rgba();
+// The color gradient fill is computed once, at a fixed high resolution
+// covering the xy range below (which contains the whole spectral locus),
+// and resampled for each plot size. Computing it per pixel for each size
+// makes resizing stutter. Plot windows zoomed in beyond the texture
+// resolution are filled per pixel instead, for the visible pixels only.
+static const QPointF gradientTextureRange(0.8, 0.9);
+static const QSize gradientTextureSize(1024, 1152);
+
+static const QImage &gradientTexture()
+{
+    static const QImage texture = []() {
+        const RGBColorSpace allColors = allColorsColorSpace();
+
+        // Every pixel gets the color for the xy coordinate at its center,
+        // also outside the horseshoe; the fill is clipped to it when drawn.
+        QImage image(gradientTextureSize, QImage::Format_RGB32);
+        QVector<float> Yxy(image.width() * 3);
+        for (int l = 0; l < image.height(); ++l) {
+            const qreal CIE_y = gradientTextureRange.y() * (image.height() - l - 0.5) / image.height();
+            for (int i = 0; i < image.width(); ++i) {
+                Yxy[i * 3 + 0] = 1;
+                Yxy[i * 3 + 1] = gradientTextureRange.x() * (i + 0.5) / image.width();
+                Yxy[i * 3 + 2] = CIE_y;
             }
+            allColors.convertYxyToRGB(Yxy.constData(), reinterpret_cast<QRgb *>(image.scanLine(l)), image.width());
         }
+        return image;
+    }();
+    return texture;
+}
 
-        // Update pixmap item with image and postion
-        pix->setPixmap(QPixmap::fromImage(xypolot));
-        pix->setOpacity(0.8);
-        QPointF itemPosition = plotArea.topLeft();
-        pix->setPos(itemPosition);
-        xypolot = QImage();
-    });
+QImage ChromaticityDiagram::renderBackground(QSize imageSize, qreal devicePixelRatio, QRectF plotWindow)
+{
+    const QPainterPath path = spectralLocusPath();
+
+    // Create cache image for drawing the xy plot, filled with transparent pixels
+    QImage xypolot = QImage(imageSize * devicePixelRatio, QImage::Format_ARGB32_Premultiplied);
+    xypolot.setDevicePixelRatio(devicePixelRatio);
+    xypolot.fill(QColor(0, 0, 0, 0));
+
+    // Fill horseshoe interior with color. With at most one texture pixel
+    // per image pixel, resample the gradient texture; else convert each
+    // interior pixel, a line span at a time.
+    const QSize pixelSize = xypolot.size();
+    const bool isZoomedIn
+        = pixelSize.width() / plotWindow.width() > gradientTextureSize.width() / gradientTextureRange.x()
+          || pixelSize.height() / plotWindow.height() > gradientTextureSize.height() / gradientTextureRange.y();
+    if (isZoomedIn) {
+        const RGBColorSpace allColors = allColorsColorSpace();
+        QVector<float> Yxy;
+        forEachSpectralLocusSpan(pixelSize, plotWindow, [&](int row, int begin, int end) {
+            const qreal CIE_y = plotWindow.bottom() - plotWindow.height() * (row + 0.5) / pixelSize.height();
+            const int count = end - begin;
+            Yxy.resize(count * 3);
+            for (int i = 0; i < count; ++i) {
+                Yxy[i * 3 + 0] = 1;
+                Yxy[i * 3 + 1] = plotWindow.left() + plotWindow.width() * (begin + i + 0.5) / pixelSize.width();
+                Yxy[i * 3 + 2] = CIE_y;
+            }
+            allColors.convertYxyToRGB(Yxy.constData(), reinterpret_cast<QRgb *>(xypolot.scanLine(row)) + begin,
+                                      count);
+        });
+    }
 
+    // Create painter, scaled to have a logical coordinate system showing
+    // plotWindow, with y increasing upwards.
+    QPainter p(&xypolot);
+    p.setRenderHint(QPainter::Antialiasing, true);
+    p.setRenderHint(QPainter::SmoothPixmapTransform, true);
+    p.scale(imageSize.width() / plotWindow.width(), imageSize.height() / plotWindow.height());
+    p.scale(1, -1);
+    p.translate(-plotWindow.left(), -plotWindow.bottom());
+
+    if (!isZoomedIn) {
+        // Map texture pixels to xy (top row at gradientTextureRange.y())
+        const QImage &texture = gradientTexture();
+        QBrush gradient(texture);
+        gradient.setTransform(QTransform(gradientTextureRange.x() / texture.width(), 0,
+                                         0, -gradientTextureRange.y() / texture.height(),
+                                         0, gradientTextureRange.y()));
+        p.fillPath(path, gradient);
+    }
 
-    // Update color item positions on resize
-    connect(m_chart, &QChart::plotAreaChanged, [this](const QRectF &plotArea){
-        for (ChromaticityColorItem *item : m_colorItems)
-            item->setPlotArea(plotArea, m_plotRange);
-        for (ChromaticityColorProfileItem *item : m_colorProfileItems)
-            item->setPlotArea(plotArea, m_plotRange);
-    });
+    // Draw monochromatic light "horseshoe" outline, which also smooths the
+    // edge of the per pixel fill.
+    QPen cosmetic(QColor(50,50,50));
+    cosmetic.setWidth(2);
+    cosmetic.setCosmetic(true);
+    p.strokePath(path, cosmetic);
 
-    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
-    setStyleSheet( "QGraphicsView { border-style: none; }" );
-    setRenderHints(QPainter::Antialiasing);
+    return xypolot;
+}
 
-    // Enable zoom on pinch
-    grabGesture(Qt::PinchGesture);
+void ChromaticityDiagram::setPlotWindow(QRectF plotWindow)
+{
+    // Keep the window inside the full diagram, and no smaller than 1/10000
+    // of it, where the "%g" axis labels still tell the ticks apart.
+    const QSizeF size = plotWindow.size().boundedTo(m_plotWindowMaximum.size())
+                                         .expandedTo(m_plotWindowMaximum.size() * 1e-4);
+    QPointF topLeft = plotWindow.center() - QPointF(size.width(), size.height()) / 2;
+    topLeft.setX(qBound(m_plotWindowMaximum.left(), topLeft.x(), m_plotWindowMaximum.right() - size.width()));
+    topLeft.setY(qBound(m_plotWindowMaximum.top(), topLeft.y(), m_plotWindowMaximum.bottom() - size.height()));
+    m_plotWindow = QRectF(topLeft, size);
+
+    m_axisX->setRange(m_plotWindow.left(), m_plotWindow.right());
+    m_axisY->setRange(m_plotWindow.top(), m_plotWindow.bottom());
+    updatePlot();
 }
 
-void ChromaticityDiagram::setPlotRange(QPointF plotRange) {
-    // Zooming in breaks the color shading alogrithm, prevent it
-    if (plotRange.x() < m_plotRangeMinimum.x())
-        plotRange = m_plotRangeMinimum;
+// Scales the plot window by factor, keeping the xy coordinate at the scene
+// position anchor in place.
+void ChromaticityDiagram::zoom(qreal factor, QPointF anchor)
+{
+    const QRectF plotArea = m_chart->plotArea();
+    if (plotArea.isEmpty())
+        return;
 
-    m_plotRange = plotRange;
-    m_axisX->setRange(0, m_plotRange.x());
-    m_axisY->setRange(0, m_plotRange.y());
-    m_scene->update(this->sceneRect());
+    const QPointF xy = scenePosToXy(anchor, plotArea, m_plotWindow);
+    setPlotWindow(QRectF(xy + (m_plotWindow.topLeft() - xy) / factor, m_plotWindow.size() / factor));
+}
+
+void ChromaticityDiagram::updatePlot()
+{
+    const QRectF plotArea = m_chart->plotArea();
+    if (plotArea.isEmpty())
+        return;
+
+    m_plotClipItem->setRect(plotArea);
+    m_backgroundItem->setPlotArea(plotArea, m_plotWindow);
+
+    for (ChromaticityColorItem *item : m_colorItems)
+        item->setPlotArea(plotArea, m_plotWindow);
+    for (ChromaticityColorProfileItem *item : m_colorProfileItems)
+        item->setPlotArea(plotArea, m_plotWindow);
+    for (ChromaticityPointCloudItem *item : m_pointCloudItems)
+        item->setPlotArea(plotArea, m_plotWindow);
 }
 
 bool ChromaticityDiagram::event(QEvent *event)
@@ -190,7 +327,8 @@ bool ChromaticityDiagram::gestureEvent(QGestureEvent *event) {
 bool ChromaticityDiagram::pinchGestureEvent(QPinchGesture *gesture) {
     QPinchGesture::ChangeFlags changeFlags = gesture->changeFlags();
     if (changeFlags & QPinchGesture::ScaleFactorChanged) {
-        setPlotRange(m_plotRange * 1.0f / gesture->scaleFactor());
+        const QPointF center = mapToScene(mapFromGlobal(gesture->centerPoint().toPoint()));
+        zoom(gesture->scaleFactor(), center);
     }
     return true;
 }
@@ -205,14 +343,22 @@ void ChromaticityDiagram::wheelEvent(QWheelEvent *event)
 #ifdef Q_OS_WASM
      // wasm: don't scroll on wheel
     Q_UNUSED(event);
-#else 
-    QGraphicsView::wheelEvent(event)
+#else
+    // Zoom in and out around the cursor, one step per 15 degrees
+    const qreal steps = event->angleDelta().y() / 120.0;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const QPoint position = event->position().toPoint();
+#else
+    const QPoint position = event->pos();
+#endif
+    zoom(std::pow(1.25, steps), mapToScene(position));
+    event->accept();
 #endif
 }
 
 void ChromaticityDiagram::addColorItem(ChromaticityColorItem *colorItem) {
-    m_scene->addItem(colorItem);
-    colorItem->setPlotArea(m_chart->plotArea(), m_plotRange);
+    colorItem->setParentItem(m_plotClipItem);
+    colorItem->setPlotArea(m_chart->plotArea(), m_plotWindow);
     m_colorItems.append(colorItem);
 }
 
@@ -226,11 +372,245 @@ void ChromaticityDiagram::clearColorItems()
 
 void ChromaticityDiagram::addColorProfileItem(ChromaticityColorProfileItem *colorProfileItem)
 {
-    colorProfileItem->addItems(m_scene);
-    colorProfileItem->setPlotArea(m_chart->plotArea(), m_plotRange);
+    colorProfileItem->addItems(m_scene, m_plotClipItem);
+    colorProfileItem->setPlotArea(m_chart->plotArea(), m_plotWindow);
     m_colorProfileItems.append(colorProfileItem);
 }
 
+void ChromaticityDiagram::addPointCloudItem(ChromaticityPointCloudItem *pointCloudItem)
+{
+    pointCloudItem->setParentItem(m_plotClipItem);
+    pointCloudItem->setPlotArea(m_chart->plotArea(), m_plotWindow);
+    m_pointCloudItems.append(pointCloudItem);
+}
+
+void ChromaticityDiagram::clearPointCloudItems()
+{
+    for (ChromaticityPointCloudItem *item : m_pointCloudItems)
+        m_scene->removeItem(item);
+    qDeleteAll(m_pointCloudItems);
+    m_pointCloudItems.clear();
+}
+
+
+#if QT_CONFIG(thread)
+// Renders a background tile and passes it to done, unless the tile was
+// cancelled while the task waited in the pool.
+class BackgroundTileTask : public QRunnable
+{
+public:
+    BackgroundTileTask(const QRectF &tileWindow, const QSharedPointer<QAtomicInt> &cancelled,
+                       const std::function<void(const QImage &)> &done)
+    :m_tileWindow(tileWindow)
+    ,m_cancelled(cancelled)
+    ,m_done(done)
+    {
+
+    }
+
+    void run() override
+    {
+        if (m_cancelled->loadAcquire())
+            return;
+        const int size = ChromaticityBackgroundItem::tileSize;
+        m_done(ChromaticityDiagram::renderBackground(QSize(size, size), 1, m_tileWindow));
+    }
+
+private:
+    QRectF m_tileWindow;
+    QSharedPointer<QAtomicInt> m_cancelled;
+    std::function<void(const QImage &)> m_done;
+};
+#endif
+
+ChromaticityBackgroundItem::ChromaticityBackgroundItem(QRectF fullWindow, QGraphicsItem *parent)
+:QGraphicsObject(parent)
+,m_fullWindow(fullWindow)
+,m_tiles(64 * 1024)
+{
+
+}
+
+void ChromaticityBackgroundItem::setPlotArea(QRectF plotArea, QRectF plotWindow)
+{
+    if (plotArea != m_plotArea)
+        prepareGeometryChange();
+    m_plotArea = plotArea;
+    m_plotWindow = plotWindow;
+    update();
+}
+
+QRectF ChromaticityBackgroundItem::boundingRect() const
+{
+    return m_plotArea;
+}
+
+// Level, x and y in 8, 28 and 28 bits (maxLevel is 20).
+quint64 ChromaticityBackgroundItem::tileKey(int level, int x, int y)
+{
+    return (quint64(level) << 56) | (quint64(x) << 28) | quint64(y);
+}
+
+// Tiles are numbered from the top left, as image pixels.
+QRectF ChromaticityBackgroundItem::tileWindow(int level, int x, int y) const
+{
+    const qreal width = m_fullWindow.width() / (1 << level);
+    const qreal height = m_fullWindow.height() / (1 << level);
+    return QRectF(m_fullWindow.left() + x * width, m_fullWindow.bottom() - (y + 1) * height, width, height);
+}
+
+QRectF ChromaticityBackgroundItem::tileSceneRect(int level, int x, int y) const
+{
+    const QRectF window = tileWindow(level, x, y);
+    return QRectF(xyToScenePos(QPointF(window.left(), window.bottom()), m_plotArea, m_plotWindow),
+                  xyToScenePos(QPointF(window.right(), window.top()), m_plotArea, m_plotWindow));
+}
+
+// The lowest level with at least one tile pixel per device pixel.
+int ChromaticityBackgroundItem::levelFor(qreal devicePixelRatio) const
+{
+    const qreal scale = qMax(m_plotArea.width() / m_plotWindow.width() * m_fullWindow.width(),
+                             m_plotArea.height() / m_plotWindow.height() * m_fullWindow.height());
+    const qreal tiles = scale * devicePixelRatio / tileSize;
+    return qMin(int(std::ceil(std::log2(qMax(tiles, qreal(1))))), int(maxLevel));
+}
+
+void ChromaticityBackgroundItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(option);
+    Q_UNUSED(widget);
+    if (m_plotArea.isEmpty() || m_plotWindow.isEmpty())
+        return;
+
+    // Tiles used by this frame: level 0, the fallback for all other tiles,
+    // then the visible tiles at the level for the current zoom, each after
+    // a coarse tile two levels up (1/4 scale) which covers it quickly.
+    // Pending tiles which are no longer used are cancelled.
+    QSet<quint64> used;
+    auto useTile = [&](int level, int x, int y, int priority) {
+        used.insert(tileKey(level, x, y));
+        requestTile(level, x, y, priority);
+    };
+    useTile(0, 0, 0, 2);
+
+    const int level = levelFor(painter->device()->devicePixelRatioF());
+    const int coarseLevel = qMax(0, level - 2);
+    const int tileCount = 1 << level;
+    const QRectF visible = m_plotWindow.intersected(m_fullWindow);
+    const qreal tileWidth = m_fullWindow.width() / tileCount;
+    const qreal tileHeight = m_fullWindow.height() / tileCount;
+    const int left = qBound(0, int((visible.left() - m_fullWindow.left()) / tileWidth), tileCount - 1);
+    const int right = qBound(0, int((visible.right() - m_fullWindow.left()) / tileWidth), tileCount - 1);
+    const int top = qBound(0, int((m_fullWindow.bottom() - visible.bottom()) / tileHeight), tileCount - 1);
+    const int bottom = qBound(0, int((m_fullWindow.bottom() - visible.top()) / tileHeight), tileCount - 1);
+
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, true);
+    for (int y = top; y <= bottom; ++y) {
+        for (int x = left; x <= right; ++x) {
+            const QRectF target = tileSceneRect(level, x, y);
+            if (const QImage *image = m_tiles.object(tileKey(level, x, y))) {
+                used.insert(tileKey(level, x, y));
+                painter->drawImage(target, *image);
+                continue;
+            }
+            const int coarseShift = level - coarseLevel;
+            useTile(coarseLevel, x >> coarseShift, y >> coarseShift, 1);
+            useTile(level, x, y, 0);
+
+            // Draw the matching part of the nearest cached tile above,
+            // which is a sub-rectangle of 1/2^(level - parentLevel) of it.
+            for (int parentLevel = level - 1; parentLevel >= 0; --parentLevel) {
+                const int shift = level - parentLevel;
+                const QImage *parent = m_tiles.object(tileKey(parentLevel, x >> shift, y >> shift));
+                if (parent == nullptr)
+                    continue;
+                const qreal size = qreal(tileSize) / (1 << shift);
+                const QRectF source((x & ((1 << shift) - 1)) * size, (y & ((1 << shift) - 1)) * size, size, size);
+                painter->drawImage(target, *parent, source);
+                break;
+            }
+        }
+    }
+
+    for (auto it = m_pendingTiles.begin(); it != m_pendingTiles.end();) {
+        if (used.contains(it.key())) {
+            ++it;
+        } else {
+            it.value()->fetchAndStoreRelease(1);
+            it = m_pendingTiles.erase(it);
+        }
+    }
+}
+
+// Starts rendering a tile which is neither cached nor pending. Higher
+// priority tiles are rendered first.
+void ChromaticityBackgroundItem::requestTile(int level, int x, int y, int priority)
+{
+    const quint64 key = tileKey(level, x, y);
+    if (m_pendingTiles.contains(key) || m_tiles.contains(key))
+        return;
+    const QSharedPointer<QAtomicInt> cancelled(new QAtomicInt(0));
+    m_pendingTiles.insert(key, cancelled);
+
+#if QT_CONFIG(thread)
+    // The result is queued to the application object, which outlives the
+    // item, and dropped there if the item has been deleted meanwhile.
+    QPointer<ChromaticityBackgroundItem> item(this);
+    auto done = [item, key, cancelled](const QImage &image) {
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [item, key, cancelled, image]() {
+            if (item)
+                item->tileRendered(key, cancelled, image);
+        }, Qt::QueuedConnection);
+    };
+    QThreadPool::globalInstance()->start(new BackgroundTileTask(tileWindow(level, x, y), cancelled, done), priority);
+#else
+    // Without threads, tiles are rendered from a timer on the GUI thread,
+    // in priority order.
+    int index = 0;
+    while (index < m_tileQueue.count() && m_tileQueue.at(index).priority >= priority)
+        ++index;
+    m_tileQueue.insert(index, TileRequest{ key, tileWindow(level, x, y), priority, cancelled });
+    if (!m_tileQueueScheduled) {
+        m_tileQueueScheduled = true;
+        QTimer::singleShot(0, this, [this]() { processTileQueue(); });
+    }
+#endif
+}
+
+#if !QT_CONFIG(thread)
+// Renders queued tiles until the frame budget is spent, and then returns
+// to the event loop (input, painting) before continuing. A tile is not
+// interrupted, so a call may overrun the budget by one tile.
+void ChromaticityBackgroundItem::processTileQueue()
+{
+    m_tileQueueScheduled = false;
+    QElapsedTimer timer;
+    timer.start();
+    while (!m_tileQueue.isEmpty() && timer.elapsed() < frameBudget) {
+        const TileRequest request = m_tileQueue.takeFirst();
+        if (request.cancelled->loadAcquire())
+            continue;
+        const QImage image = ChromaticityDiagram::renderBackground(QSize(tileSize, tileSize), 1, request.window);
+        tileRendered(request.key, request.cancelled, image);
+    }
+
+    if (!m_tileQueue.isEmpty()) {
+        m_tileQueueScheduled = true;
+        QTimer::singleShot(0, this, [this]() { processTileQueue(); });
+    }
+}
+#endif
+
+// The tile is cached also if it was cancelled after rendering started: the
+// image is valid, and may be used again.
+void ChromaticityBackgroundItem::tileRendered(quint64 key, const QSharedPointer<QAtomicInt> &cancelled,
+                                              const QImage &image)
+{
+    if (m_pendingTiles.value(key) == cancelled)
+        m_pendingTiles.remove(key);
+    m_tiles.insert(key, new QImage(image), image.bytesPerLine() * image.height() / 1024);
+    update();
+}
 
 ChromaticityColorItem::ChromaticityColorItem()
 :QGraphicsEllipseItem()
@@ -305,10 +685,10 @@ void ChromaticityColorItem::setColor(qreal x, qreal y)
     setScenePos();
 }
 
-void ChromaticityColorItem::setPlotArea(QRectF plotArea, QPointF plotRange)
+void ChromaticityColorItem::setPlotArea(QRectF plotArea, QRectF plotWindow)
 {
     m_plotArea = plotArea;
-    m_plotRange = plotRange;
+    m_plotWindow = plotWindow;
     setScenePos();
 }
 
@@ -322,7 +702,7 @@ void ChromaticityColorItem::setScenePos()
     if (m_xy.x() == -1 || m_plotArea.isEmpty())
         return;
 
-    setPos(xyToScenePos(m_xy, m_plotArea, m_plotRange));
+    setPos(xyToScenePos(m_xy, m_plotArea, m_plotWindow));
 }
 
 ChromaticityColorProfileItem::ChromaticityColorProfileItem()
@@ -377,20 +757,20 @@ void ChromaticityColorProfileItem::setVisible(bool visible)
         m_titleItem->setVisible(visible);
 }
 
-void ChromaticityColorProfileItem::setPlotArea(QRectF plotArea, QPointF plotRange)
+void ChromaticityColorProfileItem::setPlotArea(QRectF plotArea, QRectF plotWindow)
 {
     m_plotArea = plotArea;
-    m_plotRange = plotRange;
+    m_plotWindow = plotWindow;
     setScenePos();
 }
 
-void ChromaticityColorProfileItem::addItems(QGraphicsScene *scene)
+void ChromaticityColorProfileItem::addItems(QGraphicsScene *scene, QGraphicsItem *parent)
 {
     m_scene = scene;
     for (auto item : m_lineItems)
-        m_scene->addItem(item);
+        item->setParentItem(parent);
     if (m_titleItem)
-        m_scene->addItem(m_titleItem);
+        m_titleItem->setParentItem(parent);
 }
 
 void ChromaticityColorProfileItem::removeItems()
@@ -409,13 +789,126 @@ void ChromaticityColorProfileItem::setScenePos()
         return;
 
     // Create gamut triangle
-    m_lineItems[0]->setLine(QLineF(xyToScenePos(m_xy[0], m_plotArea, m_plotRange), xyToScenePos(m_xy[1], m_plotArea, m_plotRange)));
-    m_lineItems[1]->setLine(QLineF(xyToScenePos(m_xy[1], m_plotArea, m_plotRange), xyToScenePos(m_xy[2], m_plotArea, m_plotRange)));
-    m_lineItems[2]->setLine(QLineF(xyToScenePos(m_xy[2], m_plotArea, m_plotRange), xyToScenePos(m_xy[0], m_plotArea, m_plotRange)));
+    m_lineItems[0]->setLine(QLineF(xyToScenePos(m_xy[0], m_plotArea, m_plotWindow), xyToScenePos(m_xy[1], m_plotArea, m_plotWindow)));
+    m_lineItems[1]->setLine(QLineF(xyToScenePos(m_xy[1], m_plotArea, m_plotWindow), xyToScenePos(m_xy[2], m_plotArea, m_plotWindow)));
+    m_lineItems[2]->setLine(QLineF(xyToScenePos(m_xy[2], m_plotArea, m_plotWindow), xyToScenePos(m_xy[0], m_plotArea, m_plotWindow)));
 
     // Label gamut triangle
     if (m_titleItem) {
-        QPointF aboveGreen(xyToScenePos(m_xy[1], m_plotArea, m_plotRange) + QPointF(-15, -15));
+        QPointF aboveGreen(xyToScenePos(m_xy[1], m_plotArea, m_plotWindow) + QPointF(-15, -15));
         m_titleItem->setPos(aboveGreen);
     }
 }
+
+ChromaticityPointCloudItem::ChromaticityPointCloudItem()
+{
+    setOpacity(0.8);
+}
+
+void ChromaticityPointCloudItem::setColors(const QRgb *rgb, size_t count, const RGBColorSpace &colorSpace)
+{
+    QVector<float> Yxy(int(count) * 3);
+    colorSpace.convertRGBtoYxy(rgb, Yxy.data(), count);
+
+    // Counting sort by RGB555 bucket
+    const int bucketCount = 1 << 15;
+    auto bucket = [](QRgb color) {
+        return ((qRed(color) >> 3) << 10) | ((qGreen(color) >> 3) << 5) | (qBlue(color) >> 3);
+    };
+    QVector<int> offsets(bucketCount + 1, 0);
+    for (size_t i = 0; i < count; ++i)
+        ++offsets[bucket(rgb[i]) + 1];
+    for (int i = 0; i < bucketCount; ++i)
+        offsets[i + 1] += offsets[i];
+
+    m_points.resize(int(count));
+    m_bucketEnds.clear();
+    m_bucketColors.clear();
+    for (int i = 0; i < bucketCount; ++i) {
+        if (offsets[i + 1] == offsets[i])
+            continue;
+        m_bucketEnds.append(offsets[i + 1]);
+        // The center of the bucket
+        m_bucketColors.append(qRgb(((i >> 10) << 3) | 4, (((i >> 5) & 31) << 3) | 4, ((i & 31) << 3) | 4));
+    }
+    for (size_t i = 0; i < count; ++i)
+        m_points[offsets[bucket(rgb[i])]++] = Point{ Yxy[int(i) * 3 + 1], Yxy[int(i) * 3 + 2] };
+
+    update();
+}
+
+void ChromaticityPointCloudItem::clear()
+{
+    m_points.clear();
+    m_bucketEnds.clear();
+    m_bucketColors.clear();
+    update();
+}
+
+int ChromaticityPointCloudItem::count() const
+{
+    return m_points.count();
+}
+
+void ChromaticityPointCloudItem::setPointSize(qreal pointSize)
+{
+    m_pointSize = pointSize;
+    update();
+}
+
+qreal ChromaticityPointCloudItem::pointSize() const
+{
+    return m_pointSize;
+}
+
+void ChromaticityPointCloudItem::setPlotArea(QRectF plotArea, QRectF plotWindow)
+{
+    if (plotArea != m_plotArea)
+        prepareGeometryChange();
+    m_plotArea = plotArea;
+    m_plotWindow = plotWindow;
+    update();
+}
+
+QRectF ChromaticityPointCloudItem::boundingRect() const
+{
+    return m_plotArea;
+}
+
+void ChromaticityPointCloudItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    Q_UNUSED(option);
+    Q_UNUSED(widget);
+    if (m_points.isEmpty() || m_plotArea.isEmpty() || m_plotWindow.isEmpty())
+        return;
+
+    // xyToScenePos() as a scale and offset, and the visible xy range with
+    // a margin for the point size.
+    const qreal scaleX = m_plotArea.width() / m_plotWindow.width();
+    const qreal scaleY = m_plotArea.height() / m_plotWindow.height();
+    const qreal offsetX = m_plotArea.left() - m_plotWindow.left() * scaleX - m_pointSize / 2;
+    const qreal offsetY = m_plotArea.top() + m_plotWindow.bottom() * scaleY - m_pointSize / 2;
+    const QRectF visible = m_plotWindow.adjusted(-m_pointSize / scaleX, -m_pointSize / scaleY,
+                                                 m_pointSize / scaleX, m_pointSize / scaleY);
+
+    painter->setPen(Qt::NoPen);
+    m_rects.reserve(m_points.count());
+    const Point *points = m_points.constData();
+    int begin = 0;
+    for (int bucket = 0; bucket < m_bucketEnds.count(); ++bucket) {
+        const int end = m_bucketEnds.at(bucket);
+        m_rects.clear();
+        for (int i = begin; i < end; ++i) {
+            const qreal x = points[i].x;
+            const qreal y = points[i].y;
+            if (x < visible.left() || x > visible.right() || y < visible.top() || y > visible.bottom())
+                continue;
+            m_rects.append(QRectF(x * scaleX + offsetX, offsetY - y * scaleY, m_pointSize, m_pointSize));
+        }
+        begin = end;
+        if (m_rects.isEmpty())
+            continue;
+        painter->setBrush(QColor(m_bucketColors.at(bucket)));
+        painter->drawRects(m_rects.constData(), m_rects.count());
+    }
+}
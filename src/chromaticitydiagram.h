@@ -18,6 +18,8 @@ QT_CHARTS_USE_NAMESPACE
 
 class ChromaticityColorItem;
 class ChromaticityColorProfileItem;
+class ChromaticityBackgroundItem;
+class ChromaticityPointCloudItem;
 class ChromaticityDiagram : public QGraphicsView
 {
 public:
@@ -25,9 +27,24 @@ public:
     void addColorItem(ChromaticityColorItem *colorItem);
     void clearColorItems();
     void addColorProfileItem(ChromaticityColorProfileItem *colorProfileItem);
+    // The diagram takes ownership of the item; clearPointCloudItems()
+    // removes and deletes all of them.
+    void addPointCloudItem(ChromaticityPointCloudItem *pointCloudItem);
+    void clearPointCloudItems();
+
+    // Renders the diagram background (monochromatic light outline and color
+    // fill) for a plot area of imageSize device independent pixels, showing
+    // the xy coordinates in plotWindow. The color fill is resampled from a
+    // gradient texture which is computed once, or computed per pixel when
+    // zoomed in further than the texture resolution. The diagram itself
+    // draws the background from tiles, see ChromaticityBackgroundItem.
+    static QImage renderBackground(QSize imageSize, qreal devicePixelRatio, QRectF plotWindow);
 
 protected:
-    void setPlotRange(QPointF plotRange);
+    // Shows the xy coordinates in plotWindow (y increasing upwards), which
+    // is kept inside the full diagram.
+    void setPlotWindow(QRectF plotWindow);
+    void zoom(qreal factor, QPointF anchor);
     bool event(QEvent *event);
     bool gestureEvent(QGestureEvent *event);
     bool pinchGestureEvent(QPinchGesture *gesture);
@@ -35,16 +52,22 @@ protected:
     void wheelEvent(QWheelEvent * event);
 
 private:
+    void updatePlot();
+
     QGraphicsScene *m_scene;
     QChart *m_chart;
     QValueAxis *m_axisX;
     QValueAxis *m_axisY;
     
-    QPointF m_plotRangeMinimum = QPointF(0.8, 0.9);
-    QPointF m_plotRange = m_plotRangeMinimum;
+    QGraphicsRectItem *m_plotClipItem;
+    ChromaticityBackgroundItem *m_backgroundItem;
+
+    QRectF m_plotWindowMaximum = QRectF(0, 0, 0.8, 0.9);
+    QRectF m_plotWindow = m_plotWindowMaximum;
 
     QList<ChromaticityColorItem *> m_colorItems;
     QList<ChromaticityColorProfileItem *> m_colorProfileItems;
+    QList<ChromaticityPointCloudItem *> m_pointCloudItems;
 };
 
 // A Color item which is rendered as a circle on the diagram
@@ -62,13 +85,13 @@ public:
 private:
     friend class ChromaticityDiagram;
 
-    void setPlotArea(QRectF plotArea, QPointF plotRange);
+    void setPlotArea(QRectF plotArea, QRectF plotWindow);
     void setRenderColor(QColor color);
     void setScenePos();
 
     QPointF m_xy;
     QRectF m_plotArea;
-    QPointF m_plotRange;
+    QRectF m_plotWindow;
 };
 
 // A Color Profile item which is rendered as a triangle on the diagram
@@ -83,15 +106,114 @@ public:
 
 private:
     friend class ChromaticityDiagram;
-    void setPlotArea(QRectF plotArea, QPointF plotRange);
-    void addItems(QGraphicsScene *scene);
+    void setPlotArea(QRectF plotArea, QRectF plotWindow);
+    void addItems(QGraphicsScene *scene, QGraphicsItem *parent);
     void removeItems();
     void setScenePos();
 
     QPointF m_xy[3];
     QRectF m_plotArea;
-    QPointF m_plotRange;
+    QRectF m_plotWindow;
     QList<QGraphicsLineItem *>m_lineItems;
     QGraphicsSimpleTextItem *m_titleItem;
     QGraphicsScene *m_scene = nullptr;
 };
+
+// Many colors plotted as small squares, in one item. Use this instead of
+// ChromaticityColorItem for more than a few colors (image regions): the
+// points are kept in a packed array and drawn in one paint() call, with
+// one drawRects() call per group of similar colors.
+class ChromaticityPointCloudItem : public QGraphicsItem
+{
+public:
+    ChromaticityPointCloudItem();
+
+    // Replaces the points with the colors rgb, in colorSpace. Points are
+    // drawn in the color quantized to 5 bits per channel.
+    void setColors(const QRgb *rgb, size_t count, const RGBColorSpace &colorSpace);
+    void clear();
+    int count() const;
+
+    // Square size in device independent pixels
+    void setPointSize(qreal pointSize);
+    qreal pointSize() const;
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+private:
+    friend class ChromaticityDiagram;
+    void setPlotArea(QRectF plotArea, QRectF plotWindow);
+
+    struct Point
+    {
+        float x;
+        float y;
+    };
+
+    // Points sorted by color bucket; bucket i has the points
+    // [m_bucketEnds[i - 1], m_bucketEnds[i]) and the color m_bucketColors[i].
+    QVector<Point> m_points;
+    QVector<int> m_bucketEnds;
+    QVector<QRgb> m_bucketColors;
+    QVector<QRectF> m_rects;    // scratch space for paint()
+
+    qreal m_pointSize = 3;
+    QRectF m_plotArea;
+    QRectF m_plotWindow;
+};
+
+// The diagram background, drawn from a pyramid of tiles. Level 0 is one
+// tile covering the full diagram, and each level splits the tiles of the
+// level above in four. Tiles are rendered lazily on the global QThreadPool
+// and kept in a LRU cache with a memory budget. Until a tile is ready the
+// item draws the part of the nearest cached tile at a lower level, so
+// zooming and panning show a coarser background at once and refine when
+// the tiles arrive. Tiles two levels up are rendered first, and tiles no
+// longer in view are cancelled, so a resize or zoom gesture does not queue
+// up work for the sizes it passed through. The GUI thread only draws
+// tiles; without thread support, tiles are rendered from a timer within a
+// frame budget.
+class ChromaticityBackgroundItem : public QGraphicsObject
+{
+public:
+    // fullWindow is the xy range of the level 0 tile.
+    ChromaticityBackgroundItem(QRectF fullWindow, QGraphicsItem *parent = nullptr);
+
+    void setPlotArea(QRectF plotArea, QRectF plotWindow);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) override;
+
+    static const int tileSize = 256;    // pixels
+    static const int maxLevel = 20;
+    static const int frameBudget = 8;   // milliseconds, without threads
+
+private:
+    static quint64 tileKey(int level, int x, int y);
+    QRectF tileWindow(int level, int x, int y) const;
+    QRectF tileSceneRect(int level, int x, int y) const;
+    int levelFor(qreal devicePixelRatio) const;
+    void requestTile(int level, int x, int y, int priority);
+    void tileRendered(quint64 key, const QSharedPointer<QAtomicInt> &cancelled, const QImage &image);
+
+    QRectF m_fullWindow;
+    QRectF m_plotArea;
+    QRectF m_plotWindow;
+    QCache<quint64, QImage> m_tiles;    // cost in KB
+    QHash<quint64, QSharedPointer<QAtomicInt>> m_pendingTiles;  // with their cancel flags
+
+#if !QT_CONFIG(thread)
+    struct TileRequest
+    {
+        quint64 key;
+        QRectF window;
+        int priority;
+        QSharedPointer<QAtomicInt> cancelled;
+    };
+    void processTileQueue();
+
+    QVector<TileRequest> m_tileQueue;
+    bool m_tileQueueScheduled = false;
+#endif
+};
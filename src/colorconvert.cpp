@@ -1,96 +1,135 @@
 
 #include "colorconvert.h"
+#include "colorconvert_p.h"
+#include "colormatrix.h"
+#include "planarfloatimage.h"
 
 #include <iostream>
 
-QGenericMatrix<1, 3, qreal> RGBtoYxy(QColor rgb, RGBColorSpace rgbColorSpace);
-QColor YxyToRGBQColor(QGenericMatrix<1, 3, qreal> Yxy, RGBColorSpace rgbColorSpace);
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_MSVC)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+QGenericMatrix<1, 3, qreal> RGBtoYxy(QColor rgb, const RGBColorSpace &rgbColorSpace);
+QColor YxyToRGBQColor(QGenericMatrix<1, 3, qreal> Yxy, const RGBColorSpace &rgbColorSpace);
 QGenericMatrix<1, 3, qreal> toVector(QColor rgb);
 QColor toColor(QGenericMatrix<1, 3, qreal> rgb);
-QGenericMatrix<1, 3, qreal> toLinearRGB(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace);
-QGenericMatrix<1, 3, qreal> toNonlinearRGB(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace);
-QGenericMatrix<1, 3, qreal> LinearRGBtoXYZ(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace);
+QGenericMatrix<1, 3, qreal> toLinearRGB(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace);
+QGenericMatrix<1, 3, qreal> toNonlinearRGB(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace);
+QGenericMatrix<1, 3, qreal> LinearRGBtoXYZ(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace);
 qreal colorSpaceGamma(RgbColorSpace colorSpace);
 
 // RGB <-> XYZ Matrices
 // From http://www.brucelindbloom.com/index.html?Eqn_RGB_XYZ_Matrix.html
 
-static qreal sRGBtoXYZData[] =
-    { 0.4124564, 0.3575761, 0.1804375,
-      0.2126729, 0.7151522, 0.0721750,
-      0.0193339, 0.1191920, 0.9503041 };
+static constexpr Mat3 sRGBtoXYZ =
+    {{ 0.4124564, 0.3575761, 0.1804375,
+       0.2126729, 0.7151522, 0.0721750,
+       0.0193339, 0.1191920, 0.9503041 }};
 
-static qreal XYZtosRGBData[] =
-    {  3.2404542,  -1.5371385, -0.4985314,
-      -0.9692660,   1.8760108,  0.0415560,
-       0.0556434,  -0.2040259,  1.0572252 };
+static constexpr Mat3 XYZtosRGB =
+    {{  3.2404542,  -1.5371385, -0.4985314,
+       -0.9692660,   1.8760108,  0.0415560,
+        0.0556434,  -0.2040259,  1.0572252 }};
 
-static qreal adobeRGBtoXYZData[] =
-    { 0.5767309, 0.1855540, 0.1881852,
-      0.2973769, 0.6273491, 0.0752741,
-      0.0270343, 0.0706872, 0.9911085 };
+static constexpr Mat3 adobeRGBtoXYZ =
+    {{ 0.5767309, 0.1855540, 0.1881852,
+       0.2973769, 0.6273491, 0.0752741,
+       0.0270343, 0.0706872, 0.9911085 }};
 
-static qreal XYZtoAdobeRGBData[] =
-    { 2.0413690, -0.5649464, -0.3446944,
-     -0.9692660,  1.8760108,  0.0415560,
-      0.0134474, -0.1183897,  1.0154096 };
+static constexpr Mat3 XYZtoAdobeRGB =
+    {{ 2.0413690, -0.5649464, -0.3446944,
+      -0.9692660,  1.8760108,  0.0415560,
+       0.0134474, -0.1183897,  1.0154096 }};
 
-static qreal proPhotoXYZData[] =
-     { 0.7976749, 0.1351917, 0.0313534,
+static constexpr Mat3 proPhotoToXYZ =
+    {{ 0.7976749, 0.1351917, 0.0313534,
        0.2880402, 0.7118741, 0.0000857,
-       0.0000000, 0.0000000, 0.8252100 };
+       0.0000000, 0.0000000, 0.8252100 }};
 
-static qreal XYZtoProPhotoData[] =
-     { 1.3459433, -0.2556075, -0.0511118,
+static constexpr Mat3 XYZtoProPhoto =
+    {{ 1.3459433, -0.2556075, -0.0511118,
       -0.5445989,  1.5081673,  0.0205351,
-       0.0000000,  0.0000000,  1.2118128 };
+       0.0000000,  0.0000000,  1.2118128 }};
 
 // More color profiles: in RGB primaries + white point form
 // { rx, ry, gx, gy, bx, by, wx, wy }
-static qreal adobeWideGamutRGB[] = { 0.7347, 0.2653, 0.1152, 0.8264, 0.1566, 0.0177, 0.3457, 0.3585 };
-static qreal rec709[] = { 0.64, 0.33, 0.30, 0.60, 0.15, 0.06, 0.3127, 0.3290 };
-static qreal rec2020[] = { 0.708, 0.292, 0.170, 0.797, 0.131, 0.046, 0.3127, 0.3290 };
-static qreal dci_p3[] = { 0.680, 0.320, 0.265, 0.690, 0.150, 0.060, 0.3127,	0.3290 };
-
-static QGenericMatrix<3, 3, qreal> deriveNPMConversionMatrix(qreal rgbw_xy[]);
-static QGenericMatrix<3, 3, qreal> inverted(const QGenericMatrix<3, 3, qreal> &m);
-
-static QGenericMatrix<3, 3, qreal> rgbToXYZMatrices[ColorSpaceCount] =
-{
-    QGenericMatrix<3, 3, qreal>(sRGBtoXYZData),
-    QGenericMatrix<3, 3, qreal>(adobeRGBtoXYZData),
-    QGenericMatrix<3, 3, qreal>(proPhotoXYZData),
-    deriveNPMConversionMatrix(adobeWideGamutRGB),
-    deriveNPMConversionMatrix(rec709),
-    deriveNPMConversionMatrix(rec2020),
-    deriveNPMConversionMatrix(dci_p3)
+static constexpr qreal adobeWideGamutRGB[] = { 0.7347, 0.2653, 0.1152, 0.8264, 0.1566, 0.0177, 0.3457, 0.3585 };
+static constexpr qreal rec709[] = { 0.64, 0.33, 0.30, 0.60, 0.15, 0.06, 0.3127, 0.3290 };
+static constexpr qreal rec2020[] = { 0.708, 0.292, 0.170, 0.797, 0.131, 0.046, 0.3127, 0.3290 };
+static constexpr qreal dci_p3[] = { 0.680, 0.320, 0.265, 0.690, 0.150, 0.060, 0.3127, 0.3290 };
+static constexpr qreal display_p3[] = { 0.680, 0.320, 0.265, 0.690, 0.150, 0.060, 0.3127, 0.3290 };
+
+// The matrices for the built-in color spaces are computed at compile time.
+static constexpr Mat3 rgbToXYZMatrices[ColorSpaceCount] =
+{
+    sRGBtoXYZ,
+    adobeRGBtoXYZ,
+    proPhotoToXYZ,
+    deriveNPM(adobeWideGamutRGB),
+    deriveNPM(rec709),
+    deriveNPM(rec2020),
+    deriveNPM(dci_p3),
+    deriveNPM(display_p3)
 };
 
-static QGenericMatrix<3, 3, qreal> XYZtoRGBMatrices[ColorSpaceCount] =
+static constexpr Mat3 XYZtoRGBMatrices[ColorSpaceCount] =
 {
-    QGenericMatrix<3, 3, qreal>(XYZtosRGBData),
-    QGenericMatrix<3, 3, qreal>(XYZtoAdobeRGBData),
-    QGenericMatrix<3, 3, qreal>(XYZtoProPhotoData),
+    XYZtosRGB,
+    XYZtoAdobeRGB,
+    XYZtoProPhoto,
     inverted(rgbToXYZMatrices[AdobeWideGamutRGB]),
     inverted(rgbToXYZMatrices[Rec709]),
     inverted(rgbToXYZMatrices[Rec2020]),
-    inverted(rgbToXYZMatrices[DCI_P3])
+    inverted(rgbToXYZMatrices[DCI_P3]),
+    inverted(rgbToXYZMatrices[DisplayP3])
 };
 
-QString colorSpaceText[ColorSpaceCount] =
+// Fused RGB -> RGB matrices for each (source, destination) pair of built-in
+// color spaces. Conversions within a color space use the exact identity.
+// Pairs with different white points (ProPhoto and Adobe Wide Gamut are D50)
+// include the Bradford adaptation between them, which then costs nothing
+// per pixel. The white points are taken from the matrices, so that RGB white
+// maps to RGB white exactly.
+struct RgbToRgbMatrices
 {
-    QString("sRGB"),
-    QString("AdobeRGB"),
-    QString("ProPhotoRGB"),
-    QString("AdobeWideGamutRGB"),
-    QString("Rec709"),
-    QString("Rec2020"),
-    QString("DCI-P3")
+    Mat3 matrices[ColorSpaceCount][ColorSpaceCount];
+};
+
+static constexpr RgbToRgbMatrices createRgbToRgbMatrices()
+{
+    RgbToRgbMatrices result = {};
+    for (int source = 0; source < ColorSpaceCount; ++source) {
+        for (int destination = 0; destination < ColorSpaceCount; ++destination) {
+            result.matrices[source][destination] = (source == destination)
+                ? Mat3::identity()
+                : XYZtoRGBMatrices[destination]
+                  * chromaticAdaptation(bradfordConeResponse, whiteXYZ(rgbToXYZMatrices[source]),
+                                        whiteXYZ(rgbToXYZMatrices[destination]))
+                  * rgbToXYZMatrices[source];
+        }
+    }
+    return result;
+}
+
+static constexpr RgbToRgbMatrices rgbToRgbMatrices = createRgbToRgbMatrices();
+
+static const char *const colorSpaceText[ColorSpaceCount] =
+{
+    "sRGB",
+    "AdobeRGB",
+    "ProPhotoRGB",
+    "AdobeWideGamutRGB",
+    "Rec709",
+    "Rec2020",
+    "DCI-P3",
+    "DisplayP3"
 };
 
 QString colorSpaceName(RgbColorSpace colorSpace)
 {
-    return colorSpaceText[colorSpace];
+    return QString(colorSpaceText[colorSpace]);
 }
 
 QStringList colorSpaceNames()
@@ -102,29 +141,6 @@ QStringList colorSpaceNames()
     return colorSpaceNames;
 }
 
-// https://stackoverflow.com/questions/983999/simple-3x3-matrix-inverse-code-c
-static QGenericMatrix<3, 3, qreal> inverted(const QGenericMatrix<3, 3, qreal> &m)
-{
-    qreal det = m(0, 0) * (m(1, 1) * m(2, 2) - m(2, 1) * m(1, 2)) -
-                m(0, 1) * (m(1, 0) * m(2, 2) - m(1, 2) * m(2, 0)) +
-                m(0, 2) * (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0));
-
-    qreal invdet = qreal(1) / det;
-
-    QGenericMatrix<3, 3, qreal> minv; // inverse of matrix m
-    minv(0, 0) = (m(1, 1) * m(2, 2) - m(2, 1) * m(1, 2)) * invdet;
-    minv(0, 1) = (m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2)) * invdet;
-    minv(0, 2) = (m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1)) * invdet;
-    minv(1, 0) = (m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2)) * invdet;
-    minv(1, 1) = (m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0)) * invdet;
-    minv(1, 2) = (m(1, 0) * m(0, 2) - m(0, 0) * m(1, 2)) * invdet;
-    minv(2, 0) = (m(1, 0) * m(2, 1) - m(2, 0) * m(1, 1)) * invdet;
-    minv(2, 1) = (m(2, 0) * m(0, 1) - m(0, 0) * m(2, 1)) * invdet;
-    minv(2, 2) = (m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1)) * invdet;
-    
-    return minv;
-}
-
 QGenericMatrix<1, 3, qreal> pow(QGenericMatrix<1, 3, qreal> values, qreal power)
 {
     const qreal raised[] = { qPow(values(0, 0), power),
@@ -133,55 +149,12 @@ QGenericMatrix<1, 3, qreal> pow(QGenericMatrix<1, 3, qreal> values, qreal power)
     return QGenericMatrix<1, 3, qreal>(raised);
 }
 
-static QGenericMatrix<3, 3, qreal> deriveNPMConversionMatrix(qreal rxy[2], qreal gxy[2], qreal bxy[2], qreal wxy[2])
-{
-    // Derive RGB -> XYZ matrix as described in 
-    // SMPTE RP (Recommended Practice) 177.
-
-    // 3.3.2 Compute z
-    qreal rz = 1 - (rxy[0] + rxy[1]);
-    qreal gz = 1 - (gxy[0] + gxy[1]);
-    qreal bz = 1 - (bxy[0] + bxy[1]);
-    qreal wz = 1 - (wxy[0] + wxy[1]);
-    
-    // 3.3.3 Form P and W matrices
-    QGenericMatrix<3, 3, qreal> P((qreal []) {
-        rxy[0], gxy[0], bxy[0],
-        rxy[1], gxy[1], bxy[1],
-        rz,     gz,     bz
-    });
-
-    QGenericMatrix<1, 3, qreal> W((qreal []) {
-         wxy[0] / wxy[1], 1, wz / wxy[1]
-    });
-
-    // 3.3.4 Compute coefficients Ci
-    QGenericMatrix<1, 3, qreal> Ci = inverted(P) * W;
-    
-    // 3.3.5 Form the diagonal matrix C
-    QGenericMatrix<3, 3, qreal> C((qreal []) {
-          Ci(0, 0),  0,         0,
-          0,         Ci(1, 0),  0,
-          0,         0,         Ci(2, 0)
-    });
-
-    // 3.3.6 Compute the final normalized primary matrix NPM
-    QGenericMatrix<3, 3, qreal> NPM = P * C;
-
-    return NPM;
-}
-
-static QGenericMatrix<3, 3, qreal> deriveNPMConversionMatrix(qreal rgbw_xy[])
-{
-    return deriveNPMConversionMatrix(rgbw_xy + 0, rgbw_xy + 2, rgbw_xy + 4, rgbw_xy + 6);
-}
-
-QGenericMatrix<1, 3, qreal> LinearRGBtoXYZ(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> LinearRGBtoXYZ(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace)
 {
     return rgbColorSpace.RGBtoXYZMatrix() * rgb;
 }
 
-QGenericMatrix<1, 3, qreal> XYZtoLinearRGB(QGenericMatrix<1, 3, qreal> XYZ, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> XYZtoLinearRGB(QGenericMatrix<1, 3, qreal> XYZ, const RGBColorSpace &rgbColorSpace)
 {
     return rgbColorSpace.XYZtoRGBMatrix() * XYZ;
 }
@@ -205,7 +178,8 @@ static qreal gammas[ColorSpaceCount] =
     adobeWideGamutRGBGamma,
     rec709Gamma,
     rec20202Gamma,
-    dciP3Gamma
+    dciP3Gamma,
+    displayP3Gamma
 };
 
 qreal colorSpaceGamma(RgbColorSpace colorSpace)
@@ -215,33 +189,49 @@ qreal colorSpaceGamma(RgbColorSpace colorSpace)
     return gammas[colorSpace];
 }
 
-//qreal srgbToLinear(qreal nonlinear)
-//{
-//    return (nonlinear <= qreal(0.04045))
-//           ? (nonlinear / qreal(12.92))
-//           : (pow((nonlinear + qreal(0.055)/ qreal(1.055), sRGBGamma));
-//}
-
-//qreal srgbToNonLinear(qreal linear)
-//{
-//    return   (linear <= qreal(0.0031308))
-//           ? (qreal(12.92) * linear)
-//           : (qreal(1.055) * pow(linear, qreal(1.0)/ qreal(sRGBGamma)) - qreal(0.055));
-// }
+// The standard transfer functions. The gammas above are the nominal values.
+TransferFunction colorSpaceTransferFunction(RgbColorSpace colorSpace)
+{
+    switch (colorSpace) {
+    case sRGB:
+    case DisplayP3:
+        // IEC 61966-2-1
+        return TransferFunction(2.4, 1 / 1.055, 0.055 / 1.055, 1 / 12.92, 0.04045);
+    case Rec709:
+        // ITU-R BT.709 OETF
+        return TransferFunction(1 / 0.45, 1 / 1.099, 0.099 / 1.099, 1 / 4.5, 0.081);
+    case Rec2020: {
+        // ITU-R BT.2020 OETF, with the 12-bit precision constants
+        const qreal alpha = 1.09929682680944;
+        const qreal beta = 0.018053968510807;
+        return TransferFunction(1 / 0.45, 1 / alpha, (alpha - 1) / alpha, 1 / 4.5, 4.5 * beta);
+    }
+    default:
+        return TransferFunction::fromGamma(colorSpaceGamma(colorSpace));
+    }
+}
 
-QGenericMatrix<1, 3, qreal> toLinearRGB(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> toLinearRGB(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace)
 {
-    return pow(rgb, rgbColorSpace.gamma());
+    const TransferFunction transferFunction = rgbColorSpace.transferFunction();
+    const qreal linear[] = { transferFunction.toLinear(rgb(0, 0)),
+                             transferFunction.toLinear(rgb(1, 0)),
+                             transferFunction.toLinear(rgb(2, 0)) };
+    return QGenericMatrix<1, 3, qreal>(linear);
 }
 
-QGenericMatrix<1, 3, qreal> toNonlinearRGB(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> toNonlinearRGB(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace)
 {
-    return pow(rgb, qreal(1.0) / rgbColorSpace.gamma());
+    const TransferFunction transferFunction = rgbColorSpace.transferFunction();
+    const qreal nonlinear[] = { transferFunction.toNonlinear(rgb(0, 0)),
+                                transferFunction.toNonlinear(rgb(1, 0)),
+                                transferFunction.toNonlinear(rgb(2, 0)) };
+    return QGenericMatrix<1, 3, qreal>(nonlinear);
 }
 
 // RGB <-> Yxy: TODO: make this xyY
 
-QGenericMatrix<1, 3, qreal> XYZtoYxy(QGenericMatrix<1, 3, qreal> XYZ)
+QGenericMatrix<1, 3, qreal> XYZtoYxy(QGenericMatrix<1, 3, qreal> XYZ, QPointF whitePoint = QPointF(0.3127, 0.3290))
 {
     const qreal X = XYZ(0, 0);
     const qreal Y = XYZ(1, 0);
@@ -250,8 +240,8 @@ QGenericMatrix<1, 3, qreal> XYZtoYxy(QGenericMatrix<1, 3, qreal> XYZ)
     if (sum < 0.01) {
         // Black / dark grey colors cause numerical instability when the small
         // sum is used as a divisor below. Return the xy coordinates for the
-        // white point (hardcode D65), whith a Y component of 0.
-        const qreal Yxy[] = { 0, 0.3127, 0.3290 };
+        // white point, whith a Y component of 0.
+        const qreal Yxy[] = { 0, whitePoint.x(), whitePoint.y() };
         return QGenericMatrix<1, 3, qreal>(Yxy);
     }
 
@@ -261,12 +251,12 @@ QGenericMatrix<1, 3, qreal> XYZtoYxy(QGenericMatrix<1, 3, qreal> XYZ)
     return QGenericMatrix<1, 3, qreal>(Yxy);
 }
 
-QGenericMatrix<1, 3, qreal> LinearRGBtoYxy(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> LinearRGBtoYxy(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace)
 {
-    return XYZtoYxy(LinearRGBtoXYZ(rgb, rgbColorSpace));
+    return XYZtoYxy(LinearRGBtoXYZ(rgb, rgbColorSpace), rgbColorSpace.whitePoint());
 }
 
-QGenericMatrix<1, 3, qreal> RGBtoYxy(QGenericMatrix<1, 3, qreal> rgb, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> RGBtoYxy(QGenericMatrix<1, 3, qreal> rgb, const RGBColorSpace &rgbColorSpace)
 {
     return LinearRGBtoYxy(toLinearRGB(rgb, rgbColorSpace), rgbColorSpace);
 }
@@ -282,12 +272,12 @@ QGenericMatrix<1, 3, qreal> YxyToXYZ(QGenericMatrix<1, 3, qreal> Yxy)
     return QGenericMatrix<1, 3, qreal>(XYZ);
 }
 
-QGenericMatrix<1, 3, qreal> YxyToLinearRGB(QGenericMatrix<1, 3, qreal> Yxy, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> YxyToLinearRGB(QGenericMatrix<1, 3, qreal> Yxy, const RGBColorSpace &rgbColorSpace)
 {
     return XYZtoLinearRGB(YxyToXYZ(Yxy), rgbColorSpace);
 }
 
-QGenericMatrix<1, 3, qreal> YxyToRGB(QGenericMatrix<1, 3, qreal> Yxy, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> YxyToRGB(QGenericMatrix<1, 3, qreal> Yxy, const RGBColorSpace &rgbColorSpace)
 {
     return toNonlinearRGB(YxyToLinearRGB(Yxy, rgbColorSpace), rgbColorSpace);
 }
@@ -299,6 +289,11 @@ qreal clamp(qreal val, qreal min, qreal max)
     return qMax(qMin(val, max), min);
 }
 
+static inline float clamp(float val, float min, float max)
+{
+    return qMax(qMin(val, max), min);
+}
+
 QGenericMatrix<1, 3, qreal> clamp(QGenericMatrix<1, 3, qreal> rgb)
 {
     return QGenericMatrix<1, 3, qreal>((qreal []) {
@@ -321,113 +316,1102 @@ QColor toColor(QGenericMatrix<1, 3, qreal> rgb)
                   clamp(rgb(2, 0), 0, 1) * 255.0);
 }
 
-QGenericMatrix<1, 3, qreal> RGBtoYxy(QColor rgb, RGBColorSpace rgbColorSpace)
+QGenericMatrix<1, 3, qreal> RGBtoYxy(QColor rgb, const RGBColorSpace &rgbColorSpace)
 {
     return RGBtoYxy(toVector(rgb), rgbColorSpace);
 }
 
-QColor YxyToRGBQColor(QGenericMatrix<1, 3, qreal> Yxy, RGBColorSpace rgbColorSpace)
+QColor YxyToRGBQColor(QGenericMatrix<1, 3, qreal> Yxy, const RGBColorSpace &rgbColorSpace)
 {
     return toColor(YxyToRGB(Yxy, rgbColorSpace));
 }
 
-QColor convertColor(QColor color, const RGBColorSpace &source, const RGBColorSpace &destination)
+static void setHop(RgbConversionParameters::Hop *hop, const RGBColorSpace &source, const RGBColorSpace &destination,
+                   const float *toNonlinear)
 {
     // Create RGB -> RGB conversion matrix
-    QGenericMatrix<3, 3, qreal> conversion = source.RGBtoXYZMatrix() * destination.XYZtoRGBMatrix();
+    QGenericMatrix<3, 3, qreal> conversion = RGBColorSpace::createRGBtoRGBMatrix(source, destination);
+    for (int i = 0; i < 9; ++i)
+        hop->matrix[i] = conversion(i / 3, i % 3);
+    hop->toNonlinear = toNonlinear;
+}
 
-     // Convert to Linear RGB
-    QGenericMatrix<1, 3, qreal> sourceLinearRGB = toLinearRGB(toVector(color), source);
+// Returns the specialized kernel if both color spaces have built-in
+// primaries. The kernels take the transfer tables from the parameters, but
+// treat conversions within a color space as identity, so that case also
+// requires equal transfer functions.
+static RgbConversionKernel builtinKernel(const RGBColorSpace &source, const RGBColorSpace &destination)
+{
+    const RgbColorSpace sourceColorSpace = source.colorSpace();
+    const RgbColorSpace destinationColorSpace = destination.colorSpace();
+    if (sourceColorSpace == ColorSpaceCount || destinationColorSpace == ColorSpaceCount)
+        return nullptr;
+    if (sourceColorSpace == destinationColorSpace && source != destination)
+        return nullptr;
+    return builtinConversionKernel(sourceColorSpace, destinationColorSpace);
+}
 
-    // Color convert to destinationRGB
-    QGenericMatrix<1, 3, qreal> destinationLinearRGB = clamp(conversion * sourceLinearRGB);
+RgbConversionParameters rgbConversionParameters(const RGBColorSpace &source, const RGBColorSpace &destination)
+{
+    RgbConversionParameters parameters;
+    parameters.toLinear = source.m_toLinearTable.constData();
+    parameters.toNonlinearSize = RGBColorSpace::NonlinearTableSize;
+    parameters.preserveAlpha = false;
+    parameters.premultiplied = false;
+    parameters.hopCount = 1;
+    setHop(&parameters.hops[0], source, destination, destination.m_toNonlinearTable.constData());
+    parameters.builtinKernel = builtinKernel(source, destination);
+    parameters.fixedPoint = false;
+    return parameters;
+}
 
-    // Apply gamma
-    QGenericMatrix<1, 3, qreal> destinationRGB = toNonlinearRGB(destinationLinearRGB, destination);
+RgbConversionParameters rgbConversionParameters(const ColorConversionChain &chain)
+{
+    const QVector<RGBColorSpace> &colorSpaces = chain.m_colorSpaces;
+
+    RgbConversionParameters parameters;
+    parameters.toLinear = colorSpaces.first().m_toLinearTable.constData();
+    parameters.toNonlinearSize = RGBColorSpace::NonlinearTableSize;
+    parameters.preserveAlpha = false;
+    parameters.premultiplied = false;
+    parameters.hopCount = chain.hopCount();
+    for (int hop = 0; hop < parameters.hopCount; ++hop) {
+        memcpy(parameters.hops[hop].matrix, chain.m_matricesF.constData() + hop * 9, 9 * sizeof(float));
+        parameters.hops[hop].toNonlinear = colorSpaces.at(hop + 1).m_toNonlinearTable.constData();
+    }
+    parameters.builtinKernel = (parameters.hopCount == 1) ? builtinKernel(colorSpaces.at(0), colorSpaces.at(1)) : nullptr;
+    parameters.fixedPoint = false;
+    return parameters;
+}
 
+RgbConversionParameters rgbConversionParameters(const ColorTransform &transform)
+{
+    RgbConversionParameters parameters;
+    parameters.toLinear = transform.m_source.m_toLinearTable.constData();
+    parameters.toNonlinearSize = RGBColorSpace::NonlinearTableSize;
+    parameters.preserveAlpha = transform.m_flags.testFlag(ColorTransform::PreserveAlpha);
+    parameters.premultiplied = false;
+    parameters.hopCount = 1;
+    memcpy(parameters.hops[0].matrix, transform.m_matrixF, sizeof(transform.m_matrixF));
+    parameters.hops[0].toNonlinear = transform.m_destination.m_toNonlinearTable.constData();
+    parameters.builtinKernel = builtinKernel(transform.m_source, transform.m_destination);
+    parameters.fixedPoint = !transform.m_toNonlinearFixed.isEmpty();
+    parameters.toLinearFixed = transform.m_toLinearFixed.constData();
+    parameters.toNonlinearFixed = transform.m_toNonlinearFixed.constData();
+    parameters.matrixFixed = transform.m_matrixFixed;
+    return parameters;
+}
 
-    // Clip out-of-gamut colors
-    QColor destinationColor = toColor(destinationRGB);
+void convertPixelsScalar(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters)
+{
+    const float *toLinear = parameters.toLinear;
+    const int tableSize = parameters.toNonlinearSize;
+    const QRgb alphaKeep = parameters.preserveAlpha ? 0xff000000 : 0;
+    const QRgb alphaSet = parameters.preserveAlpha ? 0 : 0xff000000;
+
+    for (int i = 0; i < count; ++i) {
+        const QRgb pixel = src[i];
+        const QRgb alpha = (pixel & alphaKeep) | alphaSet;
+        int red = qRed(pixel);
+        int green = qGreen(pixel);
+        int blue = qBlue(pixel);
+
+        // Premultiplied pixels which are not opaque: skip transparent ones,
+        // unpremultiply the others
+        const int sourceAlpha = qAlpha(pixel);
+        const bool premultiply = parameters.premultiplied && sourceAlpha != 255;
+        if (premultiply) {
+            if (sourceAlpha == 0 && parameters.preserveAlpha) {
+                for (int hop = 0; hop < parameters.hopCount; ++hop) {
+                    if (dst[hop])
+                        dst[hop][i] = 0;
+                }
+                continue;
+            }
+            red = unpremultiplyIndex(red, sourceAlpha);
+            green = unpremultiplyIndex(green, sourceAlpha);
+            blue = unpremultiplyIndex(blue, sourceAlpha);
+        }
+        const int outputAlpha = parameters.preserveAlpha ? sourceAlpha : 255;
+
+        // Convert to linear RGB (table lookup)
+        float r = toLinear[red];
+        float g = toLinear[green];
+        float b = toLinear[blue];
+
+        for (int hop = 0; hop < parameters.hopCount; ++hop) {
+            // Color convert to the hop destination RGB and clip out-of-gamut colors
+            const float *m = parameters.hops[hop].matrix;
+            const float dr = clamp(m[0] * r + m[1] * g + m[2] * b, 0.0f, 1.0f);
+            const float dg = clamp(m[3] * r + m[4] * g + m[5] * b, 0.0f, 1.0f);
+            const float db = clamp(m[6] * r + m[7] * g + m[8] * b, 0.0f, 1.0f);
+            r = dr;
+            g = dg;
+            b = db;
+
+            // Apply gamma (table lookup)
+            if (dst[hop]) {
+                const float *table = parameters.hops[hop].toNonlinear;
+                int er = encodeNonlinear(r, table, tableSize);
+                int eg = encodeNonlinear(g, table, tableSize);
+                int eb = encodeNonlinear(b, table, tableSize);
+                if (premultiply && outputAlpha != 255) {
+                    er = premultiplyValue(er, outputAlpha);
+                    eg = premultiplyValue(eg, outputAlpha);
+                    eb = premultiplyValue(eb, outputAlpha);
+                }
+                dst[hop][i] = alpha | (er << 16) | (eg << 8) | eb;
+            }
+        }
+    }
+}
 
-    return destinationColor;
+// Fixed-point conversion of a premultiplied pixel which is not opaque.
+// Shared by the fixed-point kernels.
+QRgb convertPixelFixedPremultiplied(QRgb pixel, const RgbConversionParameters &parameters)
+{
+    const int alpha = qAlpha(pixel);
+    if (alpha == 0 && parameters.preserveAlpha)
+        return 0;
+
+    const quint16 *toLinear = parameters.toLinearFixed;
+    const quint8 *toNonlinear = parameters.toNonlinearFixed;
+    const qint16 *m = parameters.matrixFixed;
+    const int r = toLinear[unpremultiplyIndex(qRed(pixel), alpha)];
+    const int g = toLinear[unpremultiplyIndex(qGreen(pixel), alpha)];
+    const int b = toLinear[unpremultiplyIndex(qBlue(pixel), alpha)];
+    int er = toNonlinear[multiplyFixed(m + 0, r, g, b)];
+    int eg = toNonlinear[multiplyFixed(m + 3, r, g, b)];
+    int eb = toNonlinear[multiplyFixed(m + 6, r, g, b)];
+    if (!parameters.preserveAlpha)
+        return qRgb(er, eg, eb);
+    er = premultiplyValue(er, alpha);
+    eg = premultiplyValue(eg, alpha);
+    eb = premultiplyValue(eb, alpha);
+    return qRgba(er, eg, eb, alpha);
 }
 
-void convertImage(QImage *image, const RGBColorSpace &source, const RGBColorSpace &destination)
+// Fixed-point kernel: integer arithmetic only, so every build gives the
+// same results. Must match convertPixelsFixedSse41().
+void convertPixelsFixedScalar(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters)
 {
-    // Create RGB -> RGB conversion matrix
-    QGenericMatrix<3, 3, qreal> conversion = destination.XYZtoRGBMatrix() * source.RGBtoXYZMatrix();
-
-    int width = image->width();
-    int height = image->height();
-
-    for (int y = 0; y < height; ++y) {
-        QRgb* line = reinterpret_cast<QRgb*>(image->scanLine(y));
-        for (int x = 0; x < width; ++x) {
-            QColor sourceColor = QColor::fromRgb(*(line + x));
-            QGenericMatrix<1, 3, qreal> sourceLinearRGB = toLinearRGB(toVector(sourceColor), source);
-            QGenericMatrix<1, 3, qreal> destinationLinearRGB = clamp(conversion * sourceLinearRGB);
-            QGenericMatrix<1, 3, qreal> destinationRGB = toNonlinearRGB(destinationLinearRGB, destination);
-            QColor destinationColor = toColor(destinationRGB);
-            *(line + x) = destinationColor.rgb();
+    QRgb *out = dst[0];
+    const quint16 *toLinear = parameters.toLinearFixed;
+    const quint8 *toNonlinear = parameters.toNonlinearFixed;
+    const qint16 *m = parameters.matrixFixed;
+    const QRgb alphaKeep = parameters.preserveAlpha ? 0xff000000 : 0;
+    const QRgb alphaSet = parameters.preserveAlpha ? 0 : 0xff000000;
+
+    for (int i = 0; i < count; ++i) {
+        const QRgb pixel = src[i];
+        const int alpha = qAlpha(pixel);
+        if (parameters.premultiplied && alpha != 255) {
+            out[i] = convertPixelFixedPremultiplied(pixel, parameters);
+            continue;
+        }
+        const int r = toLinear[qRed(pixel)];
+        const int g = toLinear[qGreen(pixel)];
+        const int b = toLinear[qBlue(pixel)];
+        out[i] = ((pixel & alphaKeep) | alphaSet)
+               | (toNonlinear[multiplyFixed(m + 0, r, g, b)] << 16)
+               | (toNonlinear[multiplyFixed(m + 3, r, g, b)] << 8)
+               | toNonlinear[multiplyFixed(m + 6, r, g, b)];
+    }
+}
+
+// Scalar kernel for a pair of built-in color spaces. The fused matrix is a
+// compile-time constant, and there is no hop loop or alpha mode.
+template <RgbColorSpace Source, RgbColorSpace Destination>
+static void convertPixelsBuiltin(const QRgb *src, QRgb *const *dst, int count,
+                                 const RgbConversionParameters &parameters)
+{
+    QRgb *out = dst[0];
+    if (!out)
+        return;
+
+    const QRgb alphaKeep = parameters.preserveAlpha ? 0xff000000 : 0;
+    const QRgb alphaSet = parameters.preserveAlpha ? 0 : 0xff000000;
+
+    // Same color space: the pixels are unchanged
+    if (Source == Destination) {
+        for (int i = 0; i < count; ++i)
+            out[i] = (src[i] & (0x00ffffff | alphaKeep)) | alphaSet;
+        return;
+    }
+
+    constexpr Mat3 m = rgbToRgbMatrices.matrices[Source][Destination];
+    const float *toLinear = parameters.toLinear;
+    const float *toNonlinear = parameters.hops[0].toNonlinear;
+    const int tableSize = parameters.toNonlinearSize;
+
+    for (int i = 0; i < count; ++i) {
+        const QRgb pixel = src[i];
+        const float r = toLinear[qRed(pixel)];
+        const float g = toLinear[qGreen(pixel)];
+        const float b = toLinear[qBlue(pixel)];
+        const float dr = clamp(float(m(0, 0)) * r + float(m(0, 1)) * g + float(m(0, 2)) * b, 0.0f, 1.0f);
+        const float dg = clamp(float(m(1, 0)) * r + float(m(1, 1)) * g + float(m(1, 2)) * b, 0.0f, 1.0f);
+        const float db = clamp(float(m(2, 0)) * r + float(m(2, 1)) * g + float(m(2, 2)) * b, 0.0f, 1.0f);
+        out[i] = ((pixel & alphaKeep) | alphaSet)
+               | (encodeNonlinear(dr, toNonlinear, tableSize) << 16)
+               | (encodeNonlinear(dg, toNonlinear, tableSize) << 8)
+               | encodeNonlinear(db, toNonlinear, tableSize);
+    }
+}
+
+// The specializations for every pair, indexed by [source][destination].
+static_assert(ColorSpaceCount == 8, "Update the built-in kernel tables below");
+
+#define BUILTIN_KERNELS(Source) \
+    { &convertPixelsBuiltin<Source, sRGB>, &convertPixelsBuiltin<Source, AdobeRGB>, \
+      &convertPixelsBuiltin<Source, ProPhotoRGB>, &convertPixelsBuiltin<Source, AdobeWideGamutRGB>, \
+      &convertPixelsBuiltin<Source, Rec709>, &convertPixelsBuiltin<Source, Rec2020>, \
+      &convertPixelsBuiltin<Source, DCI_P3>, &convertPixelsBuiltin<Source, DisplayP3> }
+
+static const RgbConversionKernel builtinKernels[ColorSpaceCount][ColorSpaceCount] =
+{
+    BUILTIN_KERNELS(sRGB),
+    BUILTIN_KERNELS(AdobeRGB),
+    BUILTIN_KERNELS(ProPhotoRGB),
+    BUILTIN_KERNELS(AdobeWideGamutRGB),
+    BUILTIN_KERNELS(Rec709),
+    BUILTIN_KERNELS(Rec2020),
+    BUILTIN_KERNELS(DCI_P3),
+    BUILTIN_KERNELS(DisplayP3)
+};
+
+#undef BUILTIN_KERNELS
+
+RgbConversionKernel builtinConversionKernel(RgbColorSpace source, RgbColorSpace destination)
+{
+    Q_ASSERT(source < ColorSpaceCount && destination < ColorSpaceCount);
+    return builtinKernels[source][destination];
+}
+
+static const char *simdLevelText[] = { "scalar", "sse4.1", "avx2" };
+
+QString simdLevelName(SimdLevel level)
+{
+    return QString(simdLevelText[level]);
+}
+
+// The highest tier with kernels in this build which the CPU (and OS, for
+// the AVX register state) supports.
+static SimdLevel detectSimdLevel()
+{
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_MSVC)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = info[2] & (1 << 19);
+    const bool avx = (info[2] & (1 << 28)) && (info[2] & (1 << 27)) // AVX, OSXSAVE
+                     && (_xgetbv(0) & 0x6) == 0x6; // XMM and YMM state enabled
+    bool avx2 = false;
+    if (avx && maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = info[1] & (1 << 5);
+    }
+#elif defined(Q_PROCESSOR_X86) && defined(Q_CC_GNU)
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#else
+    const bool sse41 = false;
+    const bool avx2 = false;
+#endif
+    Q_UNUSED(sse41);
+    Q_UNUSED(avx2);
+
+#ifdef COLORCONVERT_HAVE_AVX2
+    if (avx2)
+        return SimdAvx2;
+#endif
+#ifdef COLORCONVERT_HAVE_SSE41
+    if (sse41)
+        return SimdSse41;
+#endif
+    return SimdScalar;
+}
+
+SimdLevel supportedSimdLevel()
+{
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+// The selected level, or -1 until the first call to simdLevel() or
+// setSimdLevel(). Read on every convertPixels() call.
+static QAtomicInt currentSimdLevel(-1);
+
+SimdLevel simdLevel()
+{
+    const int level = currentSimdLevel.loadAcquire();
+    if (level >= 0)
+        return SimdLevel(level);
+
+    SimdLevel selected = supportedSimdLevel();
+    const QByteArray requested = qgetenv("COLORCONVERT_SIMD").trimmed().toLower();
+    if (!requested.isEmpty()) {
+        int index = 0;
+        while (index <= SimdAvx2 && requested != simdLevelText[index])
+            ++index;
+        if (index <= SimdAvx2)
+            selected = qMin(SimdLevel(index), selected);
+        else
+            qWarning("COLORCONVERT_SIMD: unknown level \"%s\"", requested.constData());
+    }
+
+    // Another thread may have set a level meanwhile; keep that one.
+    currentSimdLevel.testAndSetOrdered(-1, selected);
+    return SimdLevel(currentSimdLevel.loadAcquire());
+}
+
+void setSimdLevel(SimdLevel level)
+{
+    currentSimdLevel.storeRelease(qMin(level, supportedSimdLevel()));
+}
+
+void convertPixels(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters)
+{
+    const SimdLevel level = simdLevel();
+    Q_UNUSED(level);
+
+    if (parameters.fixedPoint) {
+#ifdef COLORCONVERT_HAVE_SSE41
+        if (level >= SimdSse41) {
+            convertPixelsFixedSse41(src, dst, count, parameters);
+            return;
+        }
+#endif
+        convertPixelsFixedScalar(src, dst, count, parameters);
+        return;
+    }
+
+#ifdef COLORCONVERT_HAVE_AVX2
+    if (level >= SimdAvx2) {
+        convertPixelsAvx2(src, dst, count, parameters);
+        return;
+    }
+#endif
+#ifdef COLORCONVERT_HAVE_SSE41
+    if (level >= SimdSse41) {
+        convertPixelsSse41(src, dst, count, parameters);
+        return;
+    }
+#endif
+    if (parameters.builtinKernel && !parameters.premultiplied)
+        parameters.builtinKernel(src, dst, count, parameters);
+    else
+        convertPixelsScalar(src, dst, count, parameters);
+}
+
+#if QT_CONFIG(thread)
+// Worker for forEachLineBand(): processes bands until there are none left.
+class LineBandTask : public QRunnable
+{
+public:
+    LineBandTask(const std::function<void(int, int)> &function, QAtomicInt *nextBand,
+                 int bandCount, int bandHeight, int height, QSemaphore *done)
+    :m_function(function)
+    ,m_nextBand(nextBand)
+    ,m_bandCount(bandCount)
+    ,m_bandHeight(bandHeight)
+    ,m_height(height)
+    ,m_done(done)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() override
+    {
+        processBands();
+        m_done->release();
+    }
+
+    void processBands()
+    {
+        for (int band = m_nextBand->fetchAndAddRelaxed(1); band < m_bandCount;
+             band = m_nextBand->fetchAndAddRelaxed(1)) {
+            const int begin = band * m_bandHeight;
+            m_function(begin, qMin(begin + m_bandHeight, m_height));
+        }
+    }
+
+private:
+    const std::function<void(int, int)> &m_function;
+    QAtomicInt *m_nextBand;
+    int m_bandCount;
+    int m_bandHeight;
+    int m_height;
+    QSemaphore *m_done;
+};
+#endif
+
+void forEachLineBand(int width, int height, int maxThreadCount,
+                     const std::function<void(int, int)> &function)
+{
+    // Aim for bands of about 32K pixels (128 KB of QRgb), which fits in L2
+    // cache and gives enough bands for load balancing on large images.
+    const int bandPixels = 32 * 1024;
+    const int bandHeight = qMax(1, bandPixels / qMax(1, width));
+    const int bandCount = (height + bandHeight - 1) / bandHeight;
+
+    int threadCount = (maxThreadCount < 0) ? QThread::idealThreadCount() : maxThreadCount;
+    threadCount = qMin(threadCount, bandCount);
+
+#if QT_CONFIG(thread)
+    if (threadCount > 1) {
+        QAtomicInt nextBand(0);
+        QSemaphore done;
+        QVector<LineBandTask *> tasks;
+        QThreadPool *pool = QThreadPool::globalInstance();
+        for (int i = 0; i < threadCount - 1; ++i) {
+            LineBandTask *task = new LineBandTask(function, &nextBand, bandCount, bandHeight, height, &done);
+            tasks.append(task);
+            pool->start(task);
+        }
+
+        // Work on the calling thread as well. When all bands have been
+        // handed out, take back tasks which have not started yet (the pool
+        // may be busy), instead of waiting for them.
+        LineBandTask(function, &nextBand, bandCount, bandHeight, height, &done).processBands();
+        int started = 0;
+        for (LineBandTask *task : tasks) {
+            if (!pool->tryTake(task))
+                ++started;
+        }
+        done.acquire(started);
+        qDeleteAll(tasks);
+        return;
+    }
+#endif
+
+    Q_UNUSED(threadCount);
+    function(0, height);
+}
+
+// Converts source and writes the result of each hop to the corresponding
+// (non-null) output image, which may be the source image itself.
+static void convertImage(const QImage &source, const QVector<QImage *> &outputs,
+                         RgbConversionParameters parameters, int maxThreadCount)
+{
+    Q_ASSERT(outputs.count() == parameters.hopCount);
+    parameters.premultiplied = (source.format() == QImage::Format_ARGB32_Premultiplied);
+
+    const int width = source.width();
+    const int height = source.height();
+
+    // Set up output images first: reallocating or detaching an output may
+    // not move the source pixels.
+    uchar *outputBits[RgbConversionParameters::MaxHopCount];
+    int outputBytesPerLine[RgbConversionParameters::MaxHopCount];
+    for (int hop = 0; hop < parameters.hopCount; ++hop) {
+        QImage *output = outputs.at(hop);
+        if (!output) {
+            outputBits[hop] = nullptr;
+            outputBytesPerLine[hop] = 0;
+            continue;
+        }
+        if (output != &source && (output->size() != source.size() || output->format() != source.format()))
+            *output = QImage(source.size(), source.format());
+        outputBits[hop] = output->bits();
+        outputBytesPerLine[hop] = output->bytesPerLine();
+    }
+    const uchar *sourceBits = source.constBits();
+    const int sourceBytesPerLine = source.bytesPerLine();
+
+    forEachLineBand(width, height, maxThreadCount, [&](int begin, int end) {
+        QRgb *dst[RgbConversionParameters::MaxHopCount];
+        for (int y = begin; y < end; ++y) {
+            const QRgb *src = reinterpret_cast<const QRgb *>(sourceBits + y * sourceBytesPerLine);
+            for (int hop = 0; hop < parameters.hopCount; ++hop)
+                dst[hop] = outputBits[hop] ? reinterpret_cast<QRgb *>(outputBits[hop] + y * outputBytesPerLine[hop]) : nullptr;
+            convertPixels(src, dst, width, parameters);
+        }
+    });
+}
+
+namespace {
+// Channel conversion for the formats with 16-bit or float channels
+inline float channelToFloat(quint16 value) { return value * (1.0f / 65535.0f); }
+inline float channelToFloat(float value) { return value; }
+
+template <typename T> T floatToChannel(float value);
+template <> inline quint16 floatToChannel<quint16>(float value) { return quint16(clamp(value, 0.0f, 1.0f) * 65535.0f + 0.5f); }
+template <> inline float floatToChannel<float>(float value) { return value; }
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+inline float channelToFloat(qfloat16 value) { return float(value); }
+template <> inline qfloat16 floatToChannel<qfloat16>(float value) { return qfloat16(value); }
+#endif
+
+// RGBA in memory order, 4 channels of type T per pixel
+template <typename T>
+void unpackRgba(const uchar *line, int offset, int count, bool premultiplied, float *rgb, float *alpha)
+{
+    const T *pixels = reinterpret_cast<const T *>(line) + offset * 4;
+    for (int i = 0; i < count; ++i) {
+        const float a = channelToFloat(pixels[i * 4 + 3]);
+        const float scale = (premultiplied && a > 0.0f) ? 1.0f / a : 1.0f;
+        for (int c = 0; c < 3; ++c)
+            rgb[i * 3 + c] = channelToFloat(pixels[i * 4 + c]) * scale;
+        alpha[i] = a;
+    }
+}
+
+template <typename T>
+void packRgba(uchar *line, int offset, int count, bool hasAlpha, bool premultiplied, const float *rgb, const float *alpha)
+{
+    T *pixels = reinterpret_cast<T *>(line) + offset * 4;
+    for (int i = 0; i < count; ++i) {
+        const float a = hasAlpha ? alpha[i] : 1.0f;
+        const float scale = premultiplied ? a : 1.0f;
+        for (int c = 0; c < 3; ++c)
+            pixels[i * 4 + c] = floatToChannel<T>(rgb[i * 3 + c] * scale);
+        pixels[i * 4 + 3] = floatToChannel<T>(a);
+    }
+}
+
+void unpackArgb32(const uchar *line, int offset, int count, bool premultiplied, float *rgb, float *alpha)
+{
+    const QRgb *pixels = reinterpret_cast<const QRgb *>(line) + offset;
+    for (int i = 0; i < count; ++i) {
+        const QRgb pixel = pixels[i];
+        const float a = qAlpha(pixel) * (1.0f / 255.0f);
+        const float scale = (premultiplied && a > 0.0f) ? 1.0f / (a * 255.0f) : 1.0f / 255.0f;
+        rgb[i * 3 + 0] = qRed(pixel) * scale;
+        rgb[i * 3 + 1] = qGreen(pixel) * scale;
+        rgb[i * 3 + 2] = qBlue(pixel) * scale;
+        alpha[i] = a;
+    }
+}
+
+void packArgb32(uchar *line, int offset, int count, bool hasAlpha, bool premultiplied, const float *rgb, const float *alpha)
+{
+    QRgb *pixels = reinterpret_cast<QRgb *>(line) + offset;
+    for (int i = 0; i < count; ++i) {
+        const float a = hasAlpha ? clamp(alpha[i], 0.0f, 1.0f) : 1.0f;
+        const float scale = (premultiplied ? a : 1.0f) * 255.0f;
+        pixels[i] = qRgba(int(clamp(rgb[i * 3 + 0], 0.0f, 1.0f) * scale + 0.5f),
+                          int(clamp(rgb[i * 3 + 1], 0.0f, 1.0f) * scale + 0.5f),
+                          int(clamp(rgb[i * 3 + 2], 0.0f, 1.0f) * scale + 0.5f),
+                          int(a * 255.0f + 0.5f));
+    }
+}
+}
+
+bool isFloatPathFormat(QImage::Format format)
+{
+    switch (format) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4:
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+#endif
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool hasFloatLineAccess(QImage::Format format)
+{
+    return isFloatPathFormat(format)
+        || format == QImage::Format_RGB32
+        || format == QImage::Format_ARGB32
+        || format == QImage::Format_ARGB32_Premultiplied;
+}
+
+QImage::Format convertibleImageFormat(const QImage &image)
+{
+    const QImage::Format format = image.format();
+    if (hasFloatLineAccess(format) || format == QImage::Format_Invalid)
+        return format;
+    const QPixelFormat pixelFormat = QImage::toPixelFormat(format);
+    const bool hasAlpha = image.hasAlphaChannel(); // includes Indexed8 color tables with alpha
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+    if (pixelFormat.typeInterpretation() == QPixelFormat::FloatingPoint)
+        return hasAlpha ? QImage::Format_RGBA32FPx4 : QImage::Format_RGBX32FPx4;
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    if (pixelFormat.redSize() > 8)
+        return hasAlpha ? QImage::Format_RGBA64 : QImage::Format_RGBX64;
+#endif
+    return hasAlpha ? QImage::Format_ARGB32 : QImage::Format_RGB32;
+}
+
+void convertInConvertibleFormat(QImage *image, const std::function<void(QImage *)> &convert)
+{
+    if (image->isNull())
+        return;
+    const QImage::Format format = image->format();
+    const QImage::Format convertible = convertibleImageFormat(*image);
+    if (convertible == format) {
+        convert(image);
+        return;
+    }
+    QImage converted = image->convertToFormat(convertible);
+    convert(&converted);
+    *image = converted.convertToFormat(format);
+}
+
+void unpackLine(const uchar *line, QImage::Format format, int offset, int count, float *rgb, float *alpha)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+        unpackArgb32(line, offset, count, false, rgb, alpha);
+        if (format == QImage::Format_RGB32)
+            std::fill(alpha, alpha + count, 1.0f);
+        break;
+    case QImage::Format_ARGB32_Premultiplied:
+        unpackArgb32(line, offset, count, true, rgb, alpha);
+        break;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+        unpackRgba<quint16>(line, offset, count, format == QImage::Format_RGBA64_Premultiplied, rgb, alpha);
+        break;
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4:
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+        unpackRgba<qfloat16>(line, offset, count, format == QImage::Format_RGBA16FPx4_Premultiplied, rgb, alpha);
+        break;
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        unpackRgba<float>(line, offset, count, format == QImage::Format_RGBA32FPx4_Premultiplied, rgb, alpha);
+        break;
+#endif
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+void packLine(uchar *line, QImage::Format format, int offset, int count, const float *rgb, const float *alpha)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+        packArgb32(line, offset, count, format != QImage::Format_RGB32,
+                   format == QImage::Format_ARGB32_Premultiplied, rgb, alpha);
+        break;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    case QImage::Format_RGBX64:
+    case QImage::Format_RGBA64:
+    case QImage::Format_RGBA64_Premultiplied:
+        packRgba<quint16>(line, offset, count, format != QImage::Format_RGBX64,
+                          format == QImage::Format_RGBA64_Premultiplied, rgb, alpha);
+        break;
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+    case QImage::Format_RGBX16FPx4:
+    case QImage::Format_RGBA16FPx4:
+    case QImage::Format_RGBA16FPx4_Premultiplied:
+        packRgba<qfloat16>(line, offset, count, format != QImage::Format_RGBX16FPx4,
+                           format == QImage::Format_RGBA16FPx4_Premultiplied, rgb, alpha);
+        break;
+    case QImage::Format_RGBX32FPx4:
+    case QImage::Format_RGBA32FPx4:
+    case QImage::Format_RGBA32FPx4_Premultiplied:
+        packRgba<float>(line, offset, count, format != QImage::Format_RGBX32FPx4,
+                        format == QImage::Format_RGBA32FPx4_Premultiplied, rgb, alpha);
+        break;
+#endif
+    default:
+        Q_UNREACHABLE();
+    }
+}
+
+void convertImageFloat(const QImage &source, QImage *output, bool preserveAlpha, int maxThreadCount,
+                       const std::function<void(const float *, float *, size_t)> &convert)
+{
+    const QImage::Format format = source.format();
+    const int width = source.width();
+    if (output != &source && (output->size() != source.size() || output->format() != format))
+        *output = QImage(source.size(), format);
+    uchar *outputBits = output->bits();
+    const int outputBytesPerLine = output->bytesPerLine();
+    const uchar *sourceBits = (output == &source) ? outputBits : source.constBits();
+    const int sourceBytesPerLine = source.bytesPerLine();
+
+    forEachLineBand(width, source.height(), maxThreadCount, [&](int begin, int end) {
+        const int chunkSize = 256;
+        float rgb[chunkSize * 3];
+        float alpha[chunkSize];
+        for (int y = begin; y < end; ++y) {
+            const uchar *sourceLine = sourceBits + y * sourceBytesPerLine;
+            uchar *outputLine = outputBits + y * outputBytesPerLine;
+            for (int x = 0; x < width; x += chunkSize) {
+                const int count = qMin(chunkSize, width - x);
+                unpackLine(sourceLine, format, x, count, rgb, alpha);
+                convert(rgb, rgb, size_t(count));
+                if (!preserveAlpha)
+                    std::fill(alpha, alpha + count, 1.0f);
+                packLine(outputLine, format, x, count, rgb, alpha);
+            }
         }
+    });
+}
+
+// Converts interleaved nonlinear RGB floats through hopCount + 1 color spaces
+// at double precision: decode with the first transfer function, apply each
+// hop's matrix and clamp, and encode with the last transfer function.
+static void convertExact(const float *source, float *destination, size_t count,
+                         const RGBColorSpace *colorSpaces, const QGenericMatrix<3, 3, qreal> *matrices,
+                         int hopCount)
+{
+    const TransferFunction sourceTransfer = colorSpaces[0].transferFunction();
+    const TransferFunction destinationTransfer = colorSpaces[hopCount].transferFunction();
+
+    for (size_t i = 0; i < count; ++i) {
+        qreal rgb[3];
+        for (int c = 0; c < 3; ++c)
+            rgb[c] = sourceTransfer.toLinear(clamp(qreal(source[i * 3 + c]), 0, 1));
+
+        for (int hop = 0; hop < hopCount; ++hop) {
+            const QGenericMatrix<3, 3, qreal> &m = matrices[hop];
+            qreal result[3];
+            for (int row = 0; row < 3; ++row)
+                result[row] = clamp(m(row, 0) * rgb[0] + m(row, 1) * rgb[1] + m(row, 2) * rgb[2], 0, 1);
+            std::copy(result, result + 3, rgb);
+        }
+
+        for (int c = 0; c < 3; ++c)
+            destination[i * 3 + c] = float(destinationTransfer.toNonlinear(rgb[c]));
     }
 }
 
+// Converts interleaved nonlinear RGB floats through hopCount hops with the
+// approximate transfer functions. matrices holds 9 floats per hop. Each
+// chunk is decoded, multiplied and encoded in separate loops, which the
+// compiler can vectorize.
+static void convertFloatsApproximate(const float *source, float *destination, size_t count,
+                                     const float *matrices, int hopCount,
+                                     const TransferFunction &sourceTransfer,
+                                     const TransferFunction &destinationTransfer)
+{
+    const size_t chunkSize = 256;
+    float linear[chunkSize * 3];
+    while (count > 0) {
+        const size_t chunk = qMin(count, chunkSize);
+        for (size_t i = 0; i < chunk * 3; ++i)
+            linear[i] = clamp(source[i], 0.0f, 1.0f);
+        sourceTransfer.toLinearApproximate(linear, linear, chunk * 3);
+        for (int hop = 0; hop < hopCount; ++hop) {
+            const float *m = matrices + hop * 9;
+            for (size_t i = 0; i < chunk; ++i) {
+                const float r = linear[i * 3 + 0];
+                const float g = linear[i * 3 + 1];
+                const float b = linear[i * 3 + 2];
+                linear[i * 3 + 0] = clamp(m[0] * r + m[1] * g + m[2] * b, 0.0f, 1.0f);
+                linear[i * 3 + 1] = clamp(m[3] * r + m[4] * g + m[5] * b, 0.0f, 1.0f);
+                linear[i * 3 + 2] = clamp(m[6] * r + m[7] * g + m[8] * b, 0.0f, 1.0f);
+            }
+        }
+        destinationTransfer.toNonlinearApproximate(linear, destination, chunk * 3);
+        source += chunk * 3;
+        destination += chunk * 3;
+        count -= chunk;
+    }
+}
 
 RGBColorSpace::RGBColorSpace()
 :m_isValid(false)
+,m_colorSpace(ColorSpaceCount)
 ,m_gamma(1.0)
 ,m_name("null")
+,m_transferFunction(TransferFunction::fromGamma(1.0))
 {
-
+    createTransferTables();
 }
 
 RGBColorSpace::RGBColorSpace(RgbColorSpace rgbSpace)
 :m_isValid(true)
+,m_colorSpace(rgbSpace)
 ,m_gamma(colorSpaceGamma(rgbSpace))
 ,m_name(colorSpaceName(rgbSpace))
+,m_transferFunction(colorSpaceTransferFunction(rgbSpace))
 {
-    m_RGBtoXYZ = rgbToXYZMatrices[rgbSpace];
-    m_XYZtoRGB = XYZtoRGBMatrices[rgbSpace];
+    m_RGBtoXYZ = rgbToXYZMatrices[rgbSpace].toGenericMatrix();
+    m_XYZtoRGB = XYZtoRGBMatrices[rgbSpace].toGenericMatrix();
+    createTransferTables();
 }
 
 RGBColorSpace::RGBColorSpace(RgbColorSpace rgbSpace, qreal gamma)
 :m_isValid(true)
+,m_colorSpace(rgbSpace)
 ,m_gamma(gamma)
 ,m_name(colorSpaceName(rgbSpace))
+,m_transferFunction(TransferFunction::fromGamma(gamma))
 {
-    m_RGBtoXYZ = rgbToXYZMatrices[rgbSpace];
-    m_XYZtoRGB = XYZtoRGBMatrices[rgbSpace];
+    m_RGBtoXYZ = rgbToXYZMatrices[rgbSpace].toGenericMatrix();
+    m_XYZtoRGB = XYZtoRGBMatrices[rgbSpace].toGenericMatrix();
+    createTransferTables();
 }
 
 RGBColorSpace::RGBColorSpace(qreal rxy[2], qreal gxy[2], qreal bxy[2], qreal gamma, const QString &name)
 :m_isValid(true)
+,m_colorSpace(ColorSpaceCount)
 ,m_gamma(gamma)
 ,m_name(name)
+,m_transferFunction(TransferFunction::fromGamma(gamma))
 {
-    // white point (hardcode D65)
+    // These primaries come without a white point; use D65
     qreal wxy[2] = { 0.3127, 0.3290 };
 
     // create RGB <-> XYZ matrices
-    m_RGBtoXYZ = deriveNPMConversionMatrix(rxy, gxy, bxy, wxy);
-    m_XYZtoRGB = inverted(m_RGBtoXYZ);
+    const Mat3 RGBtoXYZ = deriveNPM(rxy[0], rxy[1], gxy[0], gxy[1], bxy[0], bxy[1], wxy[0], wxy[1]);
+    m_RGBtoXYZ = RGBtoXYZ.toGenericMatrix();
+    m_XYZtoRGB = inverted(RGBtoXYZ).toGenericMatrix();
+    createTransferTables();
+}
+
+RGBColorSpace::RGBColorSpace(const std::array<qreal, 8> &primaries,
+                             const std::array<std::function<qreal(qreal)>, 2> &transferFunctions,
+                             const QString &name)
+:RGBColorSpace(primaries, TransferFunction(transferFunctions[0], transferFunctions[1]), name)
+{
+
+}
+
+RGBColorSpace::RGBColorSpace(const std::array<qreal, 8> &primaries, const QString &name)
+:RGBColorSpace(primaries, colorSpaceTransferFunction(sRGB), name)
+{
+
+}
+
+RGBColorSpace::RGBColorSpace(const std::array<qreal, 8> &primaries, const TransferFunction &transferFunction,
+                             const QString &name)
+:m_isValid(true)
+,m_colorSpace(ColorSpaceCount)
+,m_name(name)
+,m_transferFunction(transferFunction)
+{
+    // Nominal gamma: the power curve which matches the transfer function at 0.5
+    m_gamma = qLn(transferFunction.toLinear(0.5)) / qLn(0.5);
+
+    const Mat3 RGBtoXYZ = deriveNPM(primaries[0], primaries[1], primaries[2], primaries[3],
+                                    primaries[4], primaries[5], primaries[6], primaries[7]);
+    m_RGBtoXYZ = RGBtoXYZ.toGenericMatrix();
+    m_XYZtoRGB = inverted(RGBtoXYZ).toGenericMatrix();
+    createTransferTables();
+}
+
+void RGBColorSpace::createTransferTables()
+{
+    // 8-bit nonlinear -> linear: one entry per possible input value.
+    m_toLinearTable.resize(256);
+    for (int i = 0; i < 256; ++i)
+        m_toLinearTable[i] = m_transferFunction.toLinear(qreal(i) / qreal(255));
+
+    // linear -> nonlinear: sampled at NonlinearTableSize intervals of
+    // sqrt(linear). The extra entry at the end makes interpolation at 1.0
+    // well-defined.
+    m_toNonlinearTable.resize(NonlinearTableSize + 1);
+    for (int i = 0; i <= NonlinearTableSize; ++i) {
+        const qreal position = qreal(i) / qreal(NonlinearTableSize);
+        m_toNonlinearTable[i] = m_transferFunction.toNonlinear(position * position) * qreal(255);
+    }
 }
 
-QGenericMatrix<1, 3, qreal> RGBColorSpace::convertRGBtoYxy(QColor rgb)
+QGenericMatrix<1, 3, qreal> RGBColorSpace::convertRGBtoYxy(QColor rgb) const
 {
     return RGBtoYxy(rgb, *this);
 }
 
-QGenericMatrix<1, 3, qreal> RGBColorSpace::convertRGBtoXYZ(QColor rgb)
+QGenericMatrix<1, 3, qreal> RGBColorSpace::convertRGBtoXYZ(QColor rgb) const
 {
     return LinearRGBtoXYZ(toLinearRGB(toVector(rgb), *this), *this);
 }
 
-QColor RGBColorSpace::convertYxyToRGB(QGenericMatrix<1, 3, qreal> Yxy)
+QColor RGBColorSpace::convertYxyToRGB(QGenericMatrix<1, 3, qreal> Yxy) const
 {
     return YxyToRGBQColor(Yxy, *this);
 }
 
+// Batch conversion. Inputs decode to linear RGB and outputs store triplets,
+// either interleaved or planar, so that one loop serves all overloads.
+
+namespace {
+struct QRgbInput
+{
+    const QRgb *rgb;
+    const float *toLinear;
+
+    void load(size_t i, float *linear) const
+    {
+        linear[0] = toLinear[qRed(rgb[i])];
+        linear[1] = toLinear[qGreen(rgb[i])];
+        linear[2] = toLinear[qBlue(rgb[i])];
+    }
+};
+
+struct FloatInput
+{
+    const float *rgb;
+    const TransferFunction *transferFunction;
+
+    void load(size_t i, float *linear) const
+    {
+        for (int c = 0; c < 3; ++c)
+            linear[c] = transferFunction->toLinearApproximate(clamp(rgb[i * 3 + c], 0.0f, 1.0f));
+    }
+};
+
+struct InterleavedOutput
+{
+    float *data;
+
+    void store(size_t i, float a, float b, float c) const
+    {
+        data[i * 3 + 0] = a;
+        data[i * 3 + 1] = b;
+        data[i * 3 + 2] = c;
+    }
+};
+
+struct PlanarOutput
+{
+    float *a;
+    float *b;
+    float *c;
+
+    void store(size_t i, float va, float vb, float vc) const
+    {
+        a[i] = va;
+        b[i] = vb;
+        c[i] = vc;
+    }
+};
+}
+
+static void toFloatMatrix(const QGenericMatrix<3, 3, qreal> &matrix, float *m)
+{
+    for (int i = 0; i < 9; ++i)
+        m[i] = float(matrix(i / 3, i % 3));
+}
+
+template <bool Yxy, typename Input, typename Output>
+static void batchRGBtoXYZ(const Input &input, const Output &output, const float *m, QPointF whitePoint,
+                          size_t count)
+{
+    const float whiteX = float(whitePoint.x());
+    const float whiteY = float(whitePoint.y());
+    for (size_t i = 0; i < count; ++i) {
+        float rgb[3];
+        input.load(i, rgb);
+        const float X = m[0] * rgb[0] + m[1] * rgb[1] + m[2] * rgb[2];
+        const float Y = m[3] * rgb[0] + m[4] * rgb[1] + m[5] * rgb[2];
+        const float Z = m[6] * rgb[0] + m[7] * rgb[1] + m[8] * rgb[2];
+        if (!Yxy) {
+            output.store(i, X, Y, Z);
+            continue;
+        }
+
+        // As XYZtoYxy(): dark colors map to the white point
+        const float sum = X + Y + Z;
+        if (sum < 0.01f)
+            output.store(i, 0.0f, whiteX, whiteY);
+        else
+            output.store(i, Y, X / sum, Y / sum);
+    }
+}
+
+// Converts Yxy to clipped linear RGB.
+static inline void YxyToClippedLinearRGB(const float *Yxy, const float *m, float *rgb)
+{
+    const float Y = Yxy[0];
+    const float x = Yxy[1];
+    const float y = Yxy[2];
+    const float scale = (y > 0.0f) ? Y / y : 0.0f;
+    const float X = scale * x;
+    const float Z = scale * (1.0f - x - y);
+    rgb[0] = clamp(m[0] * X + m[1] * Y + m[2] * Z, 0.0f, 1.0f);
+    rgb[1] = clamp(m[3] * X + m[4] * Y + m[5] * Z, 0.0f, 1.0f);
+    rgb[2] = clamp(m[6] * X + m[7] * Y + m[8] * Z, 0.0f, 1.0f);
+}
+
+void RGBColorSpace::convertRGBtoXYZ(const QRgb *rgb, float *XYZ, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_RGBtoXYZ, m);
+    batchRGBtoXYZ<false>(QRgbInput{ rgb, m_toLinearTable.constData() }, InterleavedOutput{ XYZ }, m, whitePoint(), count);
+}
+
+void RGBColorSpace::convertRGBtoXYZ(const float *rgb, float *XYZ, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_RGBtoXYZ, m);
+    batchRGBtoXYZ<false>(FloatInput{ rgb, &m_transferFunction }, InterleavedOutput{ XYZ }, m, whitePoint(), count);
+}
+
+void RGBColorSpace::convertRGBtoXYZ(const QRgb *rgb, float *X, float *Y, float *Z, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_RGBtoXYZ, m);
+    batchRGBtoXYZ<false>(QRgbInput{ rgb, m_toLinearTable.constData() }, PlanarOutput{ X, Y, Z }, m, whitePoint(), count);
+}
+
+void RGBColorSpace::convertRGBtoYxy(const QRgb *rgb, float *Yxy, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_RGBtoXYZ, m);
+    batchRGBtoXYZ<true>(QRgbInput{ rgb, m_toLinearTable.constData() }, InterleavedOutput{ Yxy }, m, whitePoint(), count);
+}
+
+void RGBColorSpace::convertRGBtoYxy(const float *rgb, float *Yxy, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_RGBtoXYZ, m);
+    batchRGBtoXYZ<true>(FloatInput{ rgb, &m_transferFunction }, InterleavedOutput{ Yxy }, m, whitePoint(), count);
+}
+
+void RGBColorSpace::convertRGBtoYxy(const QRgb *rgb, float *Y, float *x, float *y, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_RGBtoXYZ, m);
+    batchRGBtoXYZ<true>(QRgbInput{ rgb, m_toLinearTable.constData() }, PlanarOutput{ Y, x, y }, m, whitePoint(), count);
+}
+
+void RGBColorSpace::convertYxyToRGB(const float *Yxy, QRgb *rgb, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_XYZtoRGB, m);
+    for (size_t i = 0; i < count; ++i) {
+        float linear[3];
+        YxyToClippedLinearRGB(Yxy + i * 3, m, linear);
+        rgb[i] = qRgb(toNonlinear(linear[0]), toNonlinear(linear[1]), toNonlinear(linear[2]));
+    }
+}
+
+void RGBColorSpace::convertYxyToRGB(const float *Yxy, float *rgb, size_t count) const
+{
+    float m[9];
+    toFloatMatrix(m_XYZtoRGB, m);
+    for (size_t i = 0; i < count; ++i)
+        YxyToClippedLinearRGB(Yxy + i * 3, m, rgb + i * 3);
+    m_transferFunction.toNonlinearApproximate(rgb, rgb, count * 3);
+}
+
+RgbColorSpace RGBColorSpace::colorSpace() const
+{
+    return m_colorSpace;
+}
+
 QGenericMatrix<3, 3, qreal> RGBColorSpace::RGBtoXYZMatrix() const
 {
     return m_RGBtoXYZ;
@@ -438,98 +1422,582 @@ QGenericMatrix<3, 3, qreal> RGBColorSpace::XYZtoRGBMatrix() const
     return m_XYZtoRGB;
 }
 
-qreal RGBColorSpace::gamma()
+QPointF RGBColorSpace::whitePoint() const
+{
+    const Vec3 white = whiteXYZ(Mat3::fromGenericMatrix(m_RGBtoXYZ));
+    const qreal sum = white[0] + white[1] + white[2];
+    return QPointF(white[0] / sum, white[1] / sum);
+}
+
+qreal RGBColorSpace::gamma() const
 {
     return m_gamma;
 }
 
-QString RGBColorSpace::name()
+QString RGBColorSpace::name() const
 {
    return m_name;
 }
 
+TransferFunction RGBColorSpace::transferFunction() const
+{
+    return m_transferFunction;
+}
+
+bool RGBColorSpace::operator==(const RGBColorSpace &other) const
+{
+    return m_isValid == other.m_isValid
+        && m_transferFunction == other.m_transferFunction
+        && m_RGBtoXYZ == other.m_RGBtoXYZ;
+}
+
+bool RGBColorSpace::operator!=(const RGBColorSpace &other) const
+{
+    return !(*this == other);
+}
+
+uint qHash(const RGBColorSpace &colorSpace, uint seed)
+{
+    seed = qHash(colorSpace.m_transferFunction, seed);
+    const qreal *matrix = colorSpace.m_RGBtoXYZ.constData();
+    for (int i = 0; i < 9; ++i)
+        seed = qHash(matrix[i], seed) + 31 * seed;
+    return seed;
+}
+
+// Adaptation matrices for custom white points, computed once per pair of
+// white points (and method) and kept for the lifetime of the process.
+namespace {
+struct ChromaticAdaptationKey
+{
+    Vec3 sourceWhite;
+    Vec3 destinationWhite;
+    RGBColorSpace::ChromaticAdaptation method;
+
+    bool operator==(const ChromaticAdaptationKey &other) const
+    {
+        return method == other.method
+            && sourceWhite[0] == other.sourceWhite[0] && sourceWhite[1] == other.sourceWhite[1]
+            && sourceWhite[2] == other.sourceWhite[2]
+            && destinationWhite[0] == other.destinationWhite[0] && destinationWhite[1] == other.destinationWhite[1]
+            && destinationWhite[2] == other.destinationWhite[2];
+    }
+};
+
+uint qHash(const ChromaticAdaptationKey &key, uint seed = 0)
+{
+    for (int i = 0; i < 3; ++i) {
+        seed = ::qHash(key.sourceWhite[i], seed);
+        seed = ::qHash(key.destinationWhite[i], seed);
+    }
+    return seed ^ uint(key.method);
+}
+}
+
+// Process-wide LRU cache of recently used adaptation matrices, as for
+// ColorTransform::get(). The matrix is computed outside the lock.
+static Mat3 cachedChromaticAdaptation(const Vec3 &sourceWhite, const Vec3 &destinationWhite,
+                                      RGBColorSpace::ChromaticAdaptation method)
+{
+    static QMutex mutex;
+    static QCache<ChromaticAdaptationKey, Mat3> cache(64);
+
+    const ChromaticAdaptationKey key = { sourceWhite, destinationWhite, method };
+    {
+        QMutexLocker locker(&mutex);
+        if (const Mat3 *matrix = cache.object(key))
+            return *matrix;
+    }
+
+    const Mat3 &coneResponse = (method == RGBColorSpace::CAT02) ? cat02ConeResponse : bradfordConeResponse;
+    const Mat3 matrix = chromaticAdaptation(coneResponse, sourceWhite, destinationWhite);
+    QMutexLocker locker(&mutex);
+    cache.insert(key, new Mat3(matrix));
+    return matrix;
+}
+
+QGenericMatrix<3, 3, qreal> RGBColorSpace::chromaticAdaptationMatrix(QPointF sourceWhite, QPointF destinationWhite,
+                                                                     ChromaticAdaptation method)
+{
+    auto toXYZ = [](QPointF xy) {
+        return Vec3{{ xy.x() / xy.y(), 1, (1 - xy.x() - xy.y()) / xy.y() }};
+    };
+    return cachedChromaticAdaptation(toXYZ(sourceWhite), toXYZ(destinationWhite), method).toGenericMatrix();
+}
+
 QGenericMatrix<3, 3, qreal> RGBColorSpace::createRGBtoRGBMatrix(const RGBColorSpace &source,
-                                                                const RGBColorSpace &destination)
+                                                                const RGBColorSpace &destination,
+                                                                ChromaticAdaptation adaptation)
 {
-    return source.RGBtoXYZMatrix() * destination.XYZtoRGBMatrix();
+    // Use the precomputed matrix for pairs of built-in color spaces
+    if (source.m_colorSpace != ColorSpaceCount && destination.m_colorSpace != ColorSpaceCount
+        && adaptation == Bradford)
+        return rgbToRgbMatrices.matrices[source.m_colorSpace][destination.m_colorSpace].toGenericMatrix();
+
+    const Mat3 RGBtoXYZ = Mat3::fromGenericMatrix(source.m_RGBtoXYZ);
+    const Mat3 XYZtoRGB = Mat3::fromGenericMatrix(destination.m_XYZtoRGB);
+    const Vec3 sourceWhite = whiteXYZ(RGBtoXYZ);
+    const Vec3 destinationWhite = whiteXYZ(Mat3::fromGenericMatrix(destination.m_RGBtoXYZ));
+    if (sourceWhite[0] == destinationWhite[0] && sourceWhite[1] == destinationWhite[1]
+        && sourceWhite[2] == destinationWhite[2])
+        return (XYZtoRGB * RGBtoXYZ).toGenericMatrix();
+
+    return (XYZtoRGB * cachedChromaticAdaptation(sourceWhite, destinationWhite, adaptation) * RGBtoXYZ)
+        .toGenericMatrix();
 }
 
 QColor RGBColorSpace::colorConvert(QColor color, const RGBColorSpace &source, const RGBColorSpace &destination)
 {
-    return convertColor(color, source, destination);
+    return ColorTransform::get(source, destination)->apply(color);
+}
+
+void RGBColorSpace::colorConvert(const QRgb *input, QRgb *output, size_t count,
+                                 const RGBColorSpace &source, const RGBColorSpace &destination)
+{
+    ColorTransform::get(source, destination)->apply(input, output, count);
+}
+
+void RGBColorSpace::colorConvert(QImage *image, const RGBColorSpace &source, const RGBColorSpace &destination,
+                                 int maxThreadCount)
+{
+    ColorTransform::get(source, destination)->apply(image, maxThreadCount);
+}
+
+ColorTransform::ColorTransform(const RGBColorSpace &source, const RGBColorSpace &destination, Flags flags,
+                               Precision precision)
+:m_source(source)
+,m_destination(destination)
+,m_flags(flags)
+,m_precision(precision)
+,m_matrix(RGBColorSpace::createRGBtoRGBMatrix(source, destination))
+,m_isIdentity(source == destination)
+{
+    for (int i = 0; i < 9; ++i)
+        m_matrixF[i] = m_matrix(i / 3, i % 3);
+    if (precision == FixedPoint)
+        createFixedPointTables();
+}
+
+void ColorTransform::createFixedPointTables()
+{
+    // Q12 matrix. Larger coefficients (from very different gamuts) could
+    // overflow the 32-bit sums; such transforms use the float kernels.
+    const qreal scale = 1 << RgbConversionParameters::MatrixFixedShift;
+    for (int i = 0; i < 9; ++i) {
+        if (qAbs(m_matrix(i / 3, i % 3)) >= 4)
+            return;
+        m_matrixFixed[i] = qint16(qRound(m_matrix(i / 3, i % 3) * scale));
+    }
+
+    // 8-bit nonlinear -> 15-bit linear, and back. Fewer linear bits lose
+    // the steep start of pure power curves.
+    const int linearMax = RgbConversionParameters::LinearFixedMax;
+    const TransferFunction sourceTransfer = m_source.transferFunction();
+    const TransferFunction destinationTransfer = m_destination.transferFunction();
+    m_toLinearFixed.resize(256);
+    for (int i = 0; i < 256; ++i)
+        m_toLinearFixed[i] = quint16(qRound(clamp(sourceTransfer.toLinear(i / qreal(255)), 0, 1) * linearMax));
+    m_toNonlinearFixed.resize(linearMax + 1);
+    for (int i = 0; i <= linearMax; ++i)
+        m_toNonlinearFixed[i] = quint8(qRound(clamp(destinationTransfer.toNonlinear(i / qreal(linearMax)), 0, 1) * 255));
+}
+
+namespace {
+struct ColorTransformKey
+{
+    RGBColorSpace source;
+    RGBColorSpace destination;
+    ColorTransform::Flags flags;
+    ColorTransform::Precision precision;
+
+    bool operator==(const ColorTransformKey &other) const
+    {
+        return flags == other.flags && precision == other.precision
+            && source == other.source && destination == other.destination;
+    }
+};
+
+uint qHash(const ColorTransformKey &key, uint seed = 0)
+{
+    return ::qHash(key.source, seed) ^ (::qHash(key.destination, seed) * 31)
+         ^ uint(key.flags) ^ (uint(key.precision) << 8);
+}
+}
+
+QSharedPointer<const ColorTransform> ColorTransform::get(const RGBColorSpace &source, const RGBColorSpace &destination,
+                                                         Flags flags, Precision precision)
+{
+    // Process-wide LRU cache of recently used transforms.
+    static QMutex mutex;
+    static QCache<ColorTransformKey, QSharedPointer<const ColorTransform>> cache(64);
+
+    const ColorTransformKey key = { source, destination, flags, precision };
+    QMutexLocker lock(&mutex);
+    if (QSharedPointer<const ColorTransform> *transform = cache.object(key))
+        return *transform;
+
+    QSharedPointer<const ColorTransform> transform(new ColorTransform(source, destination, flags, precision));
+    cache.insert(key, new QSharedPointer<const ColorTransform>(transform));
+    return transform;
+}
+
+RGBColorSpace ColorTransform::source() const
+{
+    return m_source;
+}
+
+RGBColorSpace ColorTransform::destination() const
+{
+    return m_destination;
+}
+
+ColorTransform::Flags ColorTransform::flags() const
+{
+    return m_flags;
+}
+
+ColorTransform::Precision ColorTransform::precision() const
+{
+    return m_precision;
+}
+
+QString ColorTransform::precisionName(Precision precision)
+{
+    switch (precision) {
+    case Lookup:
+        return QStringLiteral("lookup");
+    case Approximate:
+        return QStringLiteral("approximate");
+    case Exact:
+        return QStringLiteral("exact");
+    case FixedPoint:
+        return QStringLiteral("fixed");
+    }
+    return QString();
+}
+
+QGenericMatrix<3, 3, qreal> ColorTransform::matrix() const
+{
+    return m_matrix;
+}
+
+bool ColorTransform::isIdentity() const
+{
+    return m_isIdentity;
+}
+
+void ColorTransform::apply(QImage *image, int maxThreadCount) const
+{
+    // An identity transform only changes the alpha channel (when not preserving it)
+    if (m_isIdentity && (m_flags.testFlag(PreserveAlpha) || !image->hasAlphaChannel()))
+        return;
+
+    if (convertibleImageFormat(*image) != image->format()) {
+        convertInConvertibleFormat(image, [=](QImage *converted) { apply(converted, maxThreadCount); });
+        return;
+    }
+
+    // 16-bit and floating point formats convert at float precision, as do
+    // 32-bit formats with the Approximate and Exact precisions
+    if (isFloatPathFormat(image->format()) || m_precision == Approximate || m_precision == Exact) {
+        convertImageFloat(*image, image, m_flags.testFlag(PreserveAlpha), maxThreadCount,
+                          [this](const float *source, float *destination, size_t count) {
+            apply(source, destination, count);
+        });
+        return;
+    }
+
+    convertImage(*image, QVector<QImage *>() << image, rgbConversionParameters(*this), maxThreadCount);
+}
+
+void ColorTransform::apply(PlanarFloatImage *image, int maxThreadCount) const
+{
+    if (!m_isIdentity) {
+        image->convertRgb([this](const float *source, float *destination, size_t count) {
+            apply(source, destination, count);
+        }, maxThreadCount);
+    }
+    if (!m_flags.testFlag(PreserveAlpha))
+        image->fillAlpha(1.0f);
+}
+
+void ColorTransform::apply(const QRgb *source, QRgb *destination, size_t count) const
+{
+    if (m_precision == Approximate || m_precision == Exact) {
+        convertPixelsFloat(source, destination, count);
+        return;
+    }
+
+    const RgbConversionParameters parameters = rgbConversionParameters(*this);
+
+    // The kernels take int counts; convert in chunks.
+    const size_t chunkSize = 1 << 20;
+    while (count > 0) {
+        const int chunk = int(qMin(count, chunkSize));
+        convertPixels(source, &destination, chunk, parameters);
+        source += chunk;
+        destination += chunk;
+        count -= chunk;
+    }
+}
+
+QColor ColorTransform::apply(QColor color) const
+{
+    if (m_isIdentity) {
+        if (!m_flags.testFlag(PreserveAlpha))
+            color.setAlpha(255);
+        return color;
+    }
+
+    // Convert to linear RGB
+    QGenericMatrix<1, 3, qreal> sourceLinearRGB = toLinearRGB(toVector(color), m_source);
+
+    // Color convert to destination RGB and clip out-of-gamut colors
+    QGenericMatrix<1, 3, qreal> destinationLinearRGB = clamp(m_matrix * sourceLinearRGB);
+
+    // Apply gamma
+    QGenericMatrix<1, 3, qreal> destinationRGB = toNonlinearRGB(destinationLinearRGB, m_destination);
+
+    QColor destinationColor = toColor(destinationRGB);
+    if (m_flags.testFlag(PreserveAlpha))
+        destinationColor.setAlpha(color.alpha());
+    return destinationColor;
+}
+
+void ColorTransform::apply(const float *source, float *destination, size_t count) const
+{
+    switch (m_precision) {
+    // The 8-bit tables would limit float data to 8-bit accuracy; use the
+    // approximations instead.
+    case Lookup:
+    case FixedPoint:
+    case Approximate: {
+        convertFloatsApproximate(source, destination, count, m_matrixF, 1,
+                                 m_source.m_transferFunction, m_destination.m_transferFunction);
+        break;
+    }
+    case Exact: {
+        const RGBColorSpace colorSpaces[] = { m_source, m_destination };
+        convertExact(source, destination, count, colorSpaces, &m_matrix, 1);
+        break;
+    }
+    }
+}
+
+// QRgb conversion for the Approximate and Exact precisions: unpack to
+// floats in small chunks and use the float path.
+void ColorTransform::convertPixelsFloat(const QRgb *source, QRgb *destination, size_t count) const
+{
+    const bool preserveAlpha = m_flags.testFlag(PreserveAlpha);
+    const size_t chunkSize = 256;
+    float rgb[chunkSize * 3];
+    while (count > 0) {
+        const size_t chunk = qMin(count, chunkSize);
+        for (size_t i = 0; i < chunk; ++i) {
+            rgb[i * 3 + 0] = qRed(source[i]) * (1.0f / 255.0f);
+            rgb[i * 3 + 1] = qGreen(source[i]) * (1.0f / 255.0f);
+            rgb[i * 3 + 2] = qBlue(source[i]) * (1.0f / 255.0f);
+        }
+        apply(rgb, rgb, chunk);
+        for (size_t i = 0; i < chunk; ++i) {
+            const int alpha = preserveAlpha ? qAlpha(source[i]) : 255;
+            destination[i] = qRgba(int(rgb[i * 3 + 0] * 255.0f + 0.5f),
+                                   int(rgb[i * 3 + 1] * 255.0f + 0.5f),
+                                   int(rgb[i * 3 + 2] * 255.0f + 0.5f), alpha);
+        }
+        source += chunk;
+        destination += chunk;
+        count -= chunk;
+    }
 }
 
-void RGBColorSpace::colorConvert(QImage *image, const RGBColorSpace &source, const RGBColorSpace &destination)
+ColorConversionChain::ColorConversionChain(const QVector<RGBColorSpace> &colorSpaces,
+                                           ColorTransform::Precision precision)
+:m_colorSpaces(colorSpaces)
+,m_precision(precision)
 {
-    convertImage(image, source, destination);
+    Q_ASSERT(colorSpaces.count() >= 2);
+    Q_ASSERT(colorSpaces.count() <= RgbConversionParameters::MaxHopCount + 1);
+
+    for (int hop = 0; hop < hopCount(); ++hop) {
+        const QGenericMatrix<3, 3, qreal> matrix =
+            RGBColorSpace::createRGBtoRGBMatrix(colorSpaces.at(hop), colorSpaces.at(hop + 1));
+        m_matrices.append(matrix);
+        for (int i = 0; i < 9; ++i)
+            m_matricesF.append(matrix(i / 3, i % 3));
+    }
 }
 
-// Testing
+QVector<RGBColorSpace> ColorConversionChain::colorSpaces() const
+{
+    return m_colorSpaces;
+}
+
+int ColorConversionChain::hopCount() const
+{
+    return m_colorSpaces.count() - 1;
+}
 
-#define STRINGIFY(x) #x
-#define TOSTRING(x) STRINGIFY(x)
-#define COMPARE(a, b) if (!(a == b)) qFatal("%s", QString("Test fail at %1:%2").arg(__FILE__).arg(TOSTRING(__LINE__)).toLocal8Bit().constData());
-#define VERIFY(a) if (!(a)) qFatal("%s", QString("Test fail at %1:%2").arg(__FILE__).arg(TOSTRING(__LINE__)).toLocal8Bit().constData());
+ColorTransform::Precision ColorConversionChain::precision() const
+{
+    return m_precision;
+}
 
-// qFuzzyCompare is to strict for our use case.
-bool almostEqual(qreal a, qreal b)
+// 16-bit and floating point formats convert at float precision, as do
+// 32-bit formats with the Approximate and Exact precisions
+bool ColorConversionChain::usesFloatPath(QImage::Format format) const
 {
-    return qAbs(a - b) < 0.00001;
+    return isFloatPathFormat(format) || m_precision == ColorTransform::Approximate
+        || m_precision == ColorTransform::Exact;
 }
 
-static void printme(void *c, size_t n)
+void ColorConversionChain::convert(QImage *image, int maxThreadCount) const
 {
-  unsigned char *t = (unsigned char *)c;
-  if (c == NULL)
-    return;
-  while (n > 0) {
-      int q;
-      --n;
-      for(q = 0x80; q; q >>= 1)
-        printf("%x", !!(t[n] & q));
+    if (convertibleImageFormat(*image) != image->format()) {
+        convertInConvertibleFormat(image, [=](QImage *converted) { convert(converted, maxThreadCount); });
+        return;
+    }
+    if (usesFloatPath(image->format())) {
+        convertImageFloat(*image, image, false, maxThreadCount,
+                          [this](const float *source, float *destination, size_t count) {
+            convert(source, destination, count);
+        });
+        return;
     }
-  printf("\n");
+
+    QVector<QImage *> outputs(hopCount(), nullptr);
+    outputs.last() = image;
+    convertImage(*image, outputs, rgbConversionParameters(*this), maxThreadCount);
 }
 
-void colorConvertTest()
+void ColorConversionChain::convert(PlanarFloatImage *image, int maxThreadCount) const
 {
-    // Values from color calculator at
-    // http://www.brucelindbloom.com/index.html?ColorCalculator.html
+    image->convertRgb([this](const float *source, float *destination, size_t count) {
+        convert(source, destination, count);
+    }, maxThreadCount);
+    image->fillAlpha(1.0f);
+}
 
-    // Test gamma
-    RGBColorSpace sRGBSpace(sRGB);
+void ColorConversionChain::convert(const QImage &source, const QVector<QImage *> &outputs, int maxThreadCount) const
+{
+    Q_ASSERT(outputs.count() == hopCount());
+
+    // Other formats: convert a copy, and the outputs back to the source format
+    const QImage::Format convertible = convertibleImageFormat(source);
+    if (convertible != source.format()) {
+        if (source.isNull())
+            return;
+        const QImage::Format format = source.format();
+        const QImage input = source.convertToFormat(convertible);
+        QVector<QImage> converted(hopCount());
+        QVector<QImage *> convertedOutputs(hopCount(), nullptr);
+        for (int hop = 0; hop < hopCount(); ++hop) {
+            if (outputs.at(hop))
+                convertedOutputs[hop] = &converted[hop];
+        }
+        convert(input, convertedOutputs, maxThreadCount);
+        for (int hop = 0; hop < hopCount(); ++hop) {
+            if (outputs.at(hop))
+                *outputs.at(hop) = converted.at(hop).convertToFormat(format);
+        }
+        return;
+    }
+
+    // Float path: one pass per output, last output first in case an output
+    // is the source image itself
+    if (usesFloatPath(source.format())) {
+        const QImage input = source;
+        for (int hop = hopCount() - 1; hop >= 0; --hop) {
+            if (!outputs.at(hop))
+                continue;
+            convertImageFloat(input, outputs.at(hop), false, maxThreadCount,
+                              [this, hop](const float *source, float *destination, size_t count) {
+                convert(source, destination, count, hop + 1);
+            });
+        }
+        return;
+    }
+
+    convertImage(source, outputs, rgbConversionParameters(*this), maxThreadCount);
+}
 
-    auto gammaEncoded = QGenericMatrix<1, 3, qreal>((qreal []) { 1.0, 0.5, 0.0 });
-    auto linear = toLinearRGB(gammaEncoded, sRGBSpace);
+void ColorConversionChain::convert(const float *source, float *destination, size_t count) const
+{
+    convert(source, destination, count, hopCount());
+}
 
-    // Note to self: gamma encoding distributes available values to give more coverage to
-    // lover intensities. It is therefore expected that the linear values will be
-    // smaller (or equal, for the cases of 1.0 and 0.0).
-    VERIFY(linear(0, 0) <= gammaEncoded(0, 0))
-    VERIFY(linear(1, 0) <= gammaEncoded(1, 0))
-    VERIFY(linear(2, 0) <= gammaEncoded(2, 0))
+// Converts through the first hopCount hops, to color space hopCount
+void ColorConversionChain::convert(const float *source, float *destination, size_t count, int hopCount) const
+{
+    if (m_precision == ColorTransform::Exact) {
+        convertExact(source, destination, count, m_colorSpaces.constData(), m_matrices.constData(), hopCount);
+    } else {
+        convertFloatsApproximate(source, destination, count, m_matricesF.constData(), hopCount,
+                                 m_colorSpaces.first().m_transferFunction,
+                                 m_colorSpaces.at(hopCount).m_transferFunction);
+    }
+}
 
-    // Encoding back should give the same result.
-    auto gammaEncoded2 = toNonlinearRGB(linear, sRGBSpace);
-    VERIFY(gammaEncoded == gammaEncoded2)
+// The built-in color spaces, created on first use, and kept for their tables.
+static const RGBColorSpace &builtinColorSpace(RgbColorSpace colorSpace)
+{
+    static const QVector<RGBColorSpace> colorSpaces = [] {
+        QVector<RGBColorSpace> colorSpaces;
+        for (int i = 0; i < ColorSpaceCount; ++i)
+            colorSpaces.append(RGBColorSpace(RgbColorSpace(i)));
+        return colorSpaces;
+    }();
+    return colorSpaces.at(colorSpace);
+}
 
-    // Verify converting to XYZ
-    auto XYZ = LinearRGBtoXYZ(linear, sRGBSpace);
-    // Reference for sRGB { 1.0, 0.5, 0.0 }
-    // (http://davengrace.com/cgi-bin/cspace.pl)
-    // 0.488941111836446 0.365682223672893 0.0448137039454821
-    // qDebug() << XYZ;
+static void convertBuiltin(RgbColorSpace sourceColorSpace, RgbColorSpace destinationColorSpace,
+                           RgbConversionKernel kernel, const QRgb *source, QRgb *destination, size_t count)
+{
+    RgbConversionParameters parameters = rgbConversionParameters(builtinColorSpace(sourceColorSpace),
+                                                                 builtinColorSpace(destinationColorSpace));
+    parameters.builtinKernel = kernel;
+
+    // The kernels take int counts; convert in chunks.
+    const size_t chunkSize = 1 << 20;
+    while (count > 0) {
+        const int chunk = int(qMin(count, chunkSize));
+        convertPixels(source, &destination, chunk, parameters);
+        source += chunk;
+        destination += chunk;
+        count -= chunk;
+    }
+}
 
-    // Going back to RGB should give approxemately the same values
-   auto linear2 = XYZtoLinearRGB(XYZ, sRGBSpace);
-   VERIFY(almostEqual(linear(0, 0), linear2(0, 0)));
-   VERIFY(almostEqual(linear(1, 0), linear2(1, 0)));
-   VERIFY(almostEqual(linear(2, 0), linear2(2, 0)));
+template <RgbColorSpace Source, RgbColorSpace Destination>
+void convert(const QRgb *source, QRgb *destination, size_t count)
+{
+    convertBuiltin(Source, Destination, &convertPixelsBuiltin<Source, Destination>, source, destination, count);
+}
 
-   auto roundtripMatrix = sRGBSpace.RGBtoXYZMatrix() * sRGBSpace.XYZtoRGBMatrix();
-   auto linear3 = roundtripMatrix * linear;
-   VERIFY(almostEqual(linear(0, 0), linear3(0, 0)));
-   VERIFY(almostEqual(linear(1, 0), linear3(1, 0)));
-   VERIFY(almostEqual(linear(2, 0), linear3(2, 0)));
+void convert(RgbColorSpace sourceColorSpace, RgbColorSpace destinationColorSpace,
+             const QRgb *source, QRgb *destination, size_t count)
+{
+    convertBuiltin(sourceColorSpace, destinationColorSpace,
+                   builtinConversionKernel(sourceColorSpace, destinationColorSpace), source, destination, count);
 }
 
+#define INSTANTIATE_CONVERT(Source) \
+    template void convert<Source, sRGB>(const QRgb *, QRgb *, size_t); \
+    template void convert<Source, AdobeRGB>(const QRgb *, QRgb *, size_t); \
+    template void convert<Source, ProPhotoRGB>(const QRgb *, QRgb *, size_t); \
+    template void convert<Source, AdobeWideGamutRGB>(const QRgb *, QRgb *, size_t); \
+    template void convert<Source, Rec709>(const QRgb *, QRgb *, size_t); \
+    template void convert<Source, Rec2020>(const QRgb *, QRgb *, size_t); \
+    template void convert<Source, DCI_P3>(const QRgb *, QRgb *, size_t); \
+    template void convert<Source, DisplayP3>(const QRgb *, QRgb *, size_t);
+
+INSTANTIATE_CONVERT(sRGB)
+INSTANTIATE_CONVERT(AdobeRGB)
+INSTANTIATE_CONVERT(ProPhotoRGB)
+INSTANTIATE_CONVERT(AdobeWideGamutRGB)
+INSTANTIATE_CONVERT(Rec709)
+INSTANTIATE_CONVERT(Rec2020)
+INSTANTIATE_CONVERT(DCI_P3)
+INSTANTIATE_CONVERT(DisplayP3)
+
+#undef INSTANTIATE_CONVERT
@@ -4,6 +4,8 @@
 #include <QtCore>
 #include <QtGui>
 
+#include "transferfunction.h"
+
 
 // RGB to XYZ and Yxy conversion. The conversion is dependent on
 // which RGB color space is in use. This file implements support
@@ -18,10 +20,17 @@ enum RgbColorSpace
     Rec709,
     Rec2020,
     DCI_P3,
+    DisplayP3,
     ColorSpaceCount
 };
 QString colorSpaceName(RgbColorSpace colorSpace);
 QStringList colorSpaceNames();
+TransferFunction colorSpaceTransferFunction(RgbColorSpace colorSpace);
+
+struct RgbConversionParameters;
+class ColorTransform;
+class ColorConversionChain;
+class PlanarFloatImage;
 
 // The RGBColorSpace represents a spesific RGB color space defined by the xy
 // coordinates for the red green and blue primaries, and a gamma value. Several
@@ -29,45 +38,326 @@ QStringList colorSpaceNames();
 // 
 // The class supports converting beween RGB and xyY colors.
 //
-// Implementation notes:
-//    - some color spaces (like sRGB) has picewise "gamma" functions. This
-//      class ignores this and uses a single gamma value.
-//    - the white point is hardcoded to D65 white. 
+// The built-in color spaces use their standard transfer functions, including
+// the piecewise sRGB and Rec.709/2020 curves; see colorSpaceTransferFunction().
+// Constructors taking a gamma value use a pure power curve.
+//
+// Each color space has its own white point (D65 for most of the built-in
+// spaces, D50 for ProPhoto and Adobe Wide Gamut). Conversions between
+// spaces with different white points include a chromatic adaptation, by
+// default Bradford, so that white stays white. For the built-in spaces the
+// adaptation is folded into the precomputed RGB to RGB matrices.
 
 class RGBColorSpace
 {
 public:
+    // Cone response models for chromatic adaptation.
+    enum ChromaticAdaptation {
+        Bradford,
+        CAT02
+    };
+
     RGBColorSpace();
     RGBColorSpace(RgbColorSpace rgbSpace);
     RGBColorSpace(RgbColorSpace rgbSpace, qreal gamma);
+    // Primaries and white point as { rx, ry, gx, gy, bx, by, wx, wy }. The
+    // transfer functions are { toLinear, toNonlinear }; they are sampled into
+    // the conversion tables, and called directly only for exact conversions.
     RGBColorSpace(const std::array<qreal, 8> &primaries, 
                   const std::array<std::function<qreal(qreal)>, 2> &transferFunctions,
                   const QString &name = 0);
-    RGBColorSpace(const std::array<qreal, 8> &primaries, const QString &name);
+    RGBColorSpace(const std::array<qreal, 8> &primaries, const TransferFunction &transferFunction,
+                  const QString &name);
+    RGBColorSpace(const std::array<qreal, 8> &primaries, const QString &name); // sRGB transfer function
     RGBColorSpace(qreal rxy[2], qreal gxy[2], qreal bxy[2],
                   qreal gamma, const QString &name);
 
-    QGenericMatrix<1, 3, qreal> convertRGBtoYxy(QColor rgb);
-    QGenericMatrix<1, 3, qreal> convertRGBtoXYZ(QColor rgb);
-    QColor convertYxyToRGB(QGenericMatrix<1, 3, qreal> Yxy);
+    QGenericMatrix<1, 3, qreal> convertRGBtoYxy(QColor rgb) const;
+    QGenericMatrix<1, 3, qreal> convertRGBtoXYZ(QColor rgb) const;
+    QColor convertYxyToRGB(QGenericMatrix<1, 3, qreal> Yxy) const;
+
+    // Batch conversion of count colors between contiguous buffers. Float
+    // buffers are interleaved triplets (r g b, X Y Z or Y x y, as for the
+    // single color functions above), or separate planes for the overloads
+    // taking three output pointers. Float RGB components are in [0, 1].
+    // These functions do not allocate and can be called from several
+    // threads at once. QRgb input is decoded with the 8-bit transfer table.
+    void convertRGBtoXYZ(const QRgb *rgb, float *XYZ, size_t count) const;
+    void convertRGBtoXYZ(const float *rgb, float *XYZ, size_t count) const;
+    void convertRGBtoXYZ(const QRgb *rgb, float *X, float *Y, float *Z, size_t count) const;
+    void convertRGBtoYxy(const QRgb *rgb, float *Yxy, size_t count) const;
+    void convertRGBtoYxy(const float *rgb, float *Yxy, size_t count) const;
+    void convertRGBtoYxy(const QRgb *rgb, float *Y, float *x, float *y, size_t count) const;
+
+    // Out-of-gamut colors are clipped. QRgb output is opaque.
+    void convertYxyToRGB(const float *Yxy, QRgb *rgb, size_t count) const;
+    void convertYxyToRGB(const float *Yxy, float *rgb, size_t count) const;
+
+    // The built-in color space, or ColorSpaceCount for custom color spaces.
+    RgbColorSpace colorSpace() const;
 
     QGenericMatrix<3, 3, qreal> RGBtoXYZMatrix() const;
     QGenericMatrix<3, 3, qreal> XYZtoRGBMatrix() const;
-    qreal gamma();
-    QString name();
-    
+    // The xy chromaticity of RGB white (1, 1, 1).
+    QPointF whitePoint() const;
+    // The nominal gamma. The transfer function may be piecewise; use
+    // transferFunction() for conversions.
+    qreal gamma() const;
+    QString name() const;
+    TransferFunction transferFunction() const;
+
+    // Transfer function lookup. toLinear() decodes an 8-bit color value using
+    // a 256-entry table. toNonlinear() encodes a linear [0, 1] value to 8-bit
+    // using a high-resolution table with linear interpolation. The encode
+    // table is indexed by sqrt(linear), which places more entries near black
+    // where the transfer functions are steep. The tables are built once per
+    // color space and shared between copies.
+    float toLinear(quint8 value) const;
+    quint8 toNonlinear(float linear) const;
+
+    // Color spaces are equal if they have the same primaries and transfer
+    // function (the name and nominal gamma are not compared).
+    bool operator==(const RGBColorSpace &other) const;
+    bool operator!=(const RGBColorSpace &other) const;
+
+    // Linear RGB to linear RGB, adapting the source white point to the
+    // destination white point.
     static QGenericMatrix<3, 3, qreal> createRGBtoRGBMatrix(const RGBColorSpace &source,
-                                                            const RGBColorSpace &destination);
+                                                            const RGBColorSpace &destination,
+                                                            ChromaticAdaptation adaptation = Bradford);
+    // XYZ to XYZ (von Kries in the cone response space of method). Cached
+    // per pair of white points.
+    static QGenericMatrix<3, 3, qreal> chromaticAdaptationMatrix(QPointF sourceWhite, QPointF destinationWhite,
+                                                                 ChromaticAdaptation method = Bradford);
 
+    // Converts using a cached ColorTransform, see ColorTransform::get().
     static QColor colorConvert(QColor color, const RGBColorSpace &source, const RGBColorSpace &destination);
-    static void colorConvert(QImage *image, const RGBColorSpace &source, const RGBColorSpace &destination);
+    static void colorConvert(const QRgb *input, QRgb *output, size_t count,
+                             const RGBColorSpace &source, const RGBColorSpace &destination);
+
+    // Converts the image in place. Large images are converted in row bands
+    // on the global QThreadPool; maxThreadCount caps the number of threads
+    // used (including the calling thread). -1 uses QThread::idealThreadCount().
+    static void colorConvert(QImage *image, const RGBColorSpace &source, const RGBColorSpace &destination,
+                             int maxThreadCount = -1);
 
 private:
+    friend class ColorTransform;
+    friend class ColorConversionChain;
+    friend uint qHash(const RGBColorSpace &colorSpace, uint seed);
+    friend RgbConversionParameters rgbConversionParameters(const RGBColorSpace &source,
+                                                           const RGBColorSpace &destination);
+    friend RgbConversionParameters rgbConversionParameters(const ColorConversionChain &chain);
+    friend RgbConversionParameters rgbConversionParameters(const ColorTransform &transform);
+    void createTransferTables();
+
     bool m_isValid;
+    RgbColorSpace m_colorSpace;
     QString m_name;
     qreal m_gamma;
+    TransferFunction m_transferFunction;
     QGenericMatrix<3, 3, qreal> m_RGBtoXYZ;
     QGenericMatrix<3, 3, qreal> m_XYZtoRGB;
+
+    enum { NonlinearTableSize = 4096 };
+    QVector<float> m_toLinearTable;     // 256 entries
+    QVector<float> m_toNonlinearTable;  // NonlinearTableSize + 1 entries, scaled to 0..255
+};
+
+uint qHash(const RGBColorSpace &colorSpace, uint seed = 0);
+
+// The format in which image is converted: its own format for RGB32, ARGB32,
+// ARGB32_Premultiplied and the 16-bit and floating point formats, otherwise
+// the widest of those that its channels fit in. The image conversion
+// functions convert images in other formats (RGB888, Grayscale8, Indexed8,
+// RGBA8888, ...) to this format and back.
+QImage::Format convertibleImageFormat(const QImage &image);
+
+// ColorTransform is a precompiled conversion from one color space to
+// another. It holds the fused RGB -> RGB matrix and the transfer function
+// tables, and is immutable once created. Use get() to share transforms:
+// it returns cached instances for recently used color space pairs, so
+// callers can look up a transform on each mouse move or paint without
+// rebuilding it.
+//
+// Out-of-gamut colors are clipped; see GamutMapping for alternatives. By
+// default the output alpha is set to 255 (opaque); PreserveAlpha copies the
+// source alpha instead.
+
+class ColorTransform
+{
+public:
+    enum Flag {
+        NoFlags = 0x0,
+        PreserveAlpha = 0x1
+    };
+    Q_DECLARE_FLAGS(Flags, Flag)
+
+    // How the transfer functions are evaluated by apply():
+    //    - Lookup: 8-bit tables for QRgb data (fastest). Accurate to about 1
+    //      level of 8-bit output. Float data, and 16-bit and floating point
+    //      images, use Approximate, which keeps their precision.
+    //    - Approximate: fast float approximations of the transfer functions.
+    //    - Exact: double precision.
+    //    - FixedPoint: integer arithmetic for QRgb data, with 15-bit linear
+    //      values and a Q12 matrix. The results are the same on every
+    //      platform and for every kernel. Float data uses Approximate.
+    // Single QColor conversions are always exact.
+    enum Precision {
+        Lookup,
+        Approximate,
+        Exact,
+        FixedPoint
+    };
+
+    ColorTransform(const RGBColorSpace &source, const RGBColorSpace &destination, Flags flags = NoFlags,
+                   Precision precision = Lookup);
+
+    static QSharedPointer<const ColorTransform> get(const RGBColorSpace &source, const RGBColorSpace &destination,
+                                                    Flags flags = NoFlags, Precision precision = Lookup);
+
+    RGBColorSpace source() const;
+    RGBColorSpace destination() const;
+    Flags flags() const;
+    Precision precision() const;
+    QGenericMatrix<3, 3, qreal> matrix() const;
+    bool isIdentity() const;
+
+    // "lookup", "approximate", "exact" or "fixed"
+    static QString precisionName(Precision precision);
+
+    // Converts a 32-bit image (RGB32, ARGB32 or ARGB32_Premultiplied) in place,
+    // in parallel row bands as for RGBColorSpace::colorConvert(). 16-bit
+    // (RGBX64, RGBA64) and, with Qt 6.2, floating point images are converted
+    // at float precision, as for the float overload below. Images in other
+    // formats are converted through convertibleImageFormat().
+    void apply(QImage *image, int maxThreadCount = -1) const;
+    void apply(PlanarFloatImage *image, int maxThreadCount = -1) const;
+
+    // Converts count pixels from source to destination, which may be equal.
+    void apply(const QRgb *source, QRgb *destination, size_t count) const;
+
+    // Converts a single color at full (double) precision.
+    QColor apply(QColor color) const;
+
+    // Converts count interleaved nonlinear RGB triplets with components in
+    // [0, 1]. source and destination may be equal.
+    void apply(const float *source, float *destination, size_t count) const;
+
+private:
+    friend RgbConversionParameters rgbConversionParameters(const ColorTransform &transform);
+
+    void convertPixelsFloat(const QRgb *source, QRgb *destination, size_t count) const;
+    void createFixedPointTables();
+
+    RGBColorSpace m_source;
+    RGBColorSpace m_destination;
+    Flags m_flags;
+    Precision m_precision;
+    QGenericMatrix<3, 3, qreal> m_matrix;
+    float m_matrixF[9];
+    bool m_isIdentity;
+
+    // FixedPoint tables, empty if the precision is not FixedPoint or the
+    // matrix is out of the fixed-point range
+    qint16 m_matrixFixed[9];
+    QVector<quint16> m_toLinearFixed;   // 256 entries
+    QVector<quint8> m_toNonlinearFixed; // indexed by linear value
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(ColorTransform::Flags)
+
+// ColorConversionChain converts images through a sequence of color spaces
+// (for example source -> working -> display) in a single pass: pixels are
+// decoded once from the first color space, taken through each hop in linear
+// RGB, and encoded only for the color spaces where output is requested.
+// Out-of-gamut colors are clipped at each hop, as with separate conversions.
+// Up to four hops are supported.
+//
+// The hop matrices are computed once, when the chain is created. The
+// precision is as for ColorTransform, except that FixedPoint converts 8-bit
+// images as Lookup does.
+
+class ColorConversionChain
+{
+public:
+    ColorConversionChain(const QVector<RGBColorSpace> &colorSpaces,
+                         ColorTransform::Precision precision = ColorTransform::Lookup);
+
+    QVector<RGBColorSpace> colorSpaces() const;
+    int hopCount() const;
+    ColorTransform::Precision precision() const;
+
+    // Converts image from the first to the last color space, in place.
+    // 16-bit and floating point images are converted at float precision, as
+    // for the float overload below. Images in other formats are converted
+    // through convertibleImageFormat().
+    void convert(QImage *image, int maxThreadCount = -1) const;
+    void convert(PlanarFloatImage *image, int maxThreadCount = -1) const;
+
+    // Converts source, writing the image as it is in color space i + 1 to
+    // outputs[i]. Null outputs are skipped, and an output may be the source
+    // image itself. Outputs are reallocated if they do not match the size
+    // and format of source.
+    void convert(const QImage &source, const QVector<QImage *> &outputs, int maxThreadCount = -1) const;
+
+    // Converts count interleaved nonlinear RGB triplets from the first to the
+    // last color space, as for ColorTransform::apply().
+    void convert(const float *source, float *destination, size_t count) const;
+
+private:
+    friend RgbConversionParameters rgbConversionParameters(const ColorConversionChain &chain);
+
+    bool usesFloatPath(QImage::Format format) const;
+    void convert(const float *source, float *destination, size_t count, int hopCount) const;
+
+    QVector<RGBColorSpace> m_colorSpaces;
+    ColorTransform::Precision m_precision;
+    QVector<QGenericMatrix<3, 3, qreal>> m_matrices;
+    QVector<float> m_matricesF; // 9 per hop, row major
+};
+
+// Converts count pixels between two built-in color spaces with their default
+// gamma, setting alpha to 255. Every (Source, Destination) pair is a separate
+// specialization with the fused conversion matrix compiled in as constants.
+// This avoids the ColorTransform lookup, and is the fastest path on builds
+// without SIMD kernels (for example WebAssembly) and at SimdScalar. The
+// non-template overload picks the specialization at run time.
+template <RgbColorSpace Source, RgbColorSpace Destination>
+void convert(const QRgb *source, QRgb *destination, size_t count);
+void convert(RgbColorSpace sourceColorSpace, RgbColorSpace destinationColorSpace,
+             const QRgb *source, QRgb *destination, size_t count);
+
+// Instruction set tiers for the 8-bit image conversion kernels. The highest
+// tier supported by both the build and the CPU is used by default, so one
+// binary runs the best kernel on each machine. For benchmarking and
+// debugging the tier can be lowered with setSimdLevel(), or with the
+// COLORCONVERT_SIMD environment variable ("scalar", "sse4.1" or "avx2"),
+// which is read on first use. Requests above supportedSimdLevel() are
+// clamped to it.
+enum SimdLevel
+{
+    SimdScalar,
+    SimdSse41,
+    SimdAvx2
+};
+QString simdLevelName(SimdLevel level);
+SimdLevel supportedSimdLevel();
+SimdLevel simdLevel();
+void setSimdLevel(SimdLevel level);
+
+inline float RGBColorSpace::toLinear(quint8 value) const
+{
+    return m_toLinearTable.constData()[value];
+}
+
+inline quint8 RGBColorSpace::toNonlinear(float linear) const
+{
+    const float position = std::sqrt(linear) * NonlinearTableSize;
+    const int index = qMin(int(position), int(NonlinearTableSize) - 1);
+    const float fraction = position - index;
+    const float *table = m_toNonlinearTable.constData();
+    return quint8(table[index] + fraction * (table[index + 1] - table[index]) + 0.5f);
+}
+
 #endif
@@ -1,4 +1,29 @@
 INCLUDEPATH += $$PWD
 
-HEADERS += $$PWD/colorconvert.h
-SOURCES += $$PWD/colorconvert.cpp
+# colormatrix.h uses C++14 constexpr
+CONFIG += c++14
+
+# The transfer function approximations rely on loop vectorization, which
+# GCC enables at -O2 only from GCC 12, and then for few loops.
+gcc: QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
+
+HEADERS += $$PWD/colorconvert.h \
+           $$PWD/colorconvert_p.h \
+           $$PWD/colormatrix.h \
+           $$PWD/colorlut.h \
+           $$PWD/colorvalidation.h \
+           $$PWD/gamutmapping.h \
+           $$PWD/transferfunction.h \
+           $$PWD/planarfloatimage.h
+SOURCES += $$PWD/colorconvert.cpp \
+           $$PWD/colorlut.cpp \
+           $$PWD/colorvalidation.cpp \
+           $$PWD/gamutmapping.cpp \
+           $$PWD/transferfunction.cpp \
+           $$PWD/planarfloatimage.cpp
+
+# The SIMD kernels are compiled with their own instruction set flags, and
+# selected at runtime from the CPU features; see simdLevel().
+CONFIG += simd
+SSE4_1_SOURCES += $$PWD/colorconvert_sse4.cpp
+AVX2_SOURCES += $$PWD/colorconvert_avx2.cpp
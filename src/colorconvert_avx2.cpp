@@ -0,0 +1,120 @@
+#include "colorconvert_p.h"
+
+#ifdef COLORCONVERT_HAVE_AVX2
+
+#include <immintrin.h>
+
+// AVX2 kernel: converts eight pixels per iteration, using gather loads for
+// the decode and encode table lookups.
+
+static inline __m256i encode8(__m256 linear, const float *table, __m256 tableSize, __m256i maxIndex)
+{
+    const __m256 position = _mm256_mul_ps(_mm256_sqrt_ps(linear), tableSize);
+    const __m256i index = _mm256_min_epi32(_mm256_cvttps_epi32(position), maxIndex);
+    const __m256 fraction = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+    const __m256 t0 = _mm256_i32gather_ps(table, index, 4);
+    const __m256 t1 = _mm256_i32gather_ps(table + 1, index, 4);
+    const __m256 value = _mm256_add_ps(_mm256_add_ps(t0, _mm256_mul_ps(fraction, _mm256_sub_ps(t1, t0))),
+                                       _mm256_set1_ps(0.5f));
+    return _mm256_cvttps_epi32(value);
+}
+
+// Premultiplied alpha, as unpremultiplyIndex() and premultiplyValue()
+static inline __m256i unpremultiply8(__m256i value, __m256 scale)
+{
+    const __m256 index = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(value), scale), _mm256_set1_ps(0.5f));
+    return _mm256_min_epi32(_mm256_cvttps_epi32(index), _mm256_set1_epi32(255));
+}
+
+static inline __m256i premultiply8(__m256i value, __m256i alpha)
+{
+    const __m256 product = _mm256_cvtepi32_ps(_mm256_mullo_epi32(value, alpha));
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_div_ps(product, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+}
+
+void convertPixelsAvx2(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 tableSize = _mm256_set1_ps(float(parameters.toNonlinearSize));
+    const __m256i maxIndex = _mm256_set1_epi32(parameters.toNonlinearSize - 1);
+    const __m256i byteMask = _mm256_set1_epi32(0xff);
+    // Alpha is either copied from the source (keep) or set to 255 (set)
+    const __m256i alphaKeep = _mm256_set1_epi32(parameters.preserveAlpha ? int(0xff000000) : 0);
+    const __m256i alphaSet = _mm256_set1_epi32(parameters.preserveAlpha ? 0 : int(0xff000000));
+    const float *toLinear = parameters.toLinear;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i red = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask);
+        __m256i green = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask);
+        __m256i blue = _mm256_and_si256(pixels, byteMask);
+
+        // Premultiplied pixels: opaque blocks take the straight path, fully
+        // transparent blocks are stored as 0 if alpha is kept, and other
+        // blocks are unpremultiplied
+        const __m256i sourceAlpha = _mm256_srli_epi32(pixels, 24);
+        bool premultiply = false;
+        if (parameters.premultiplied && _mm256_movemask_epi8(_mm256_cmpeq_epi32(sourceAlpha, byteMask)) != -1) {
+            if (parameters.preserveAlpha && _mm256_testz_si256(sourceAlpha, sourceAlpha)) {
+                for (int hop = 0; hop < parameters.hopCount; ++hop) {
+                    if (dst[hop])
+                        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst[hop] + i), _mm256_setzero_si256());
+                }
+                continue;
+            }
+            const __m256 scale = _mm256_div_ps(_mm256_set1_ps(255.0f),
+                                               _mm256_cvtepi32_ps(_mm256_max_epi32(sourceAlpha, _mm256_set1_epi32(1))));
+            red = unpremultiply8(red, scale);
+            green = unpremultiply8(green, scale);
+            blue = unpremultiply8(blue, scale);
+            premultiply = parameters.preserveAlpha;
+        }
+
+        // Decode to linear RGB
+        const __m256 r = _mm256_i32gather_ps(toLinear, red, 4);
+        const __m256 g = _mm256_i32gather_ps(toLinear, green, 4);
+        const __m256 b = _mm256_i32gather_ps(toLinear, blue, 4);
+
+        const __m256i alpha = _mm256_or_si256(_mm256_and_si256(pixels, alphaKeep), alphaSet);
+
+        __m256 dr = r, dg = g, db = b;
+        for (int hop = 0; hop < parameters.hopCount; ++hop) {
+            // Apply the conversion matrix and clamp
+            const float *m = parameters.hops[hop].matrix;
+            const __m256 sr = dr, sg = dg, sb = db;
+            dr = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[0]), sr), _mm256_mul_ps(_mm256_set1_ps(m[1]), sg)),
+                               _mm256_mul_ps(_mm256_set1_ps(m[2]), sb));
+            dg = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[3]), sr), _mm256_mul_ps(_mm256_set1_ps(m[4]), sg)),
+                               _mm256_mul_ps(_mm256_set1_ps(m[5]), sb));
+            db = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(m[6]), sr), _mm256_mul_ps(_mm256_set1_ps(m[7]), sg)),
+                               _mm256_mul_ps(_mm256_set1_ps(m[8]), sb));
+            dr = _mm256_min_ps(_mm256_max_ps(dr, zero), one);
+            dg = _mm256_min_ps(_mm256_max_ps(dg, zero), one);
+            db = _mm256_min_ps(_mm256_max_ps(db, zero), one);
+
+            if (!dst[hop])
+                continue;
+
+            // Encode and repack
+            const float *table = parameters.hops[hop].toNonlinear;
+            __m256i er = encode8(dr, table, tableSize, maxIndex);
+            __m256i eg = encode8(dg, table, tableSize, maxIndex);
+            __m256i eb = encode8(db, table, tableSize, maxIndex);
+            if (premultiply) {
+                er = premultiply8(er, sourceAlpha);
+                eg = premultiply8(eg, sourceAlpha);
+                eb = premultiply8(eb, sourceAlpha);
+            }
+            __m256i result = _mm256_or_si256(alpha, _mm256_slli_epi32(er, 16));
+            result = _mm256_or_si256(result, _mm256_slli_epi32(eg, 8));
+            result = _mm256_or_si256(result, eb);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst[hop] + i), result);
+        }
+    }
+
+    convertPixelsTail(src, dst, i, count, parameters);
+}
+
+#endif // COLORCONVERT_HAVE_AVX2
@@ -0,0 +1,182 @@
+#ifndef COLORCONVERT_P_H
+#define COLORCONVERT_P_H
+
+#include "colorconvert.h"
+
+#include <math.h>
+
+// Internal image conversion kernels. Not part of the public API.
+//
+// A kernel converts count QRgb pixels from src through one or more color
+// space hops: decode to linear RGB once using the source table, then for
+// each hop apply the hop's RGB -> RGB matrix and clamp to [0, 1]. If
+// dst[hop] is not null the pixels are encoded with the hop's destination
+// table and stored there. dst buffers may be the same as src. The output
+// alpha is set to 255, or copied from the source if preserveAlpha is set.
+//
+// With premultiplied set, the pixels are premultiplied (ARGB32_Premultiplied):
+// the kernels unpremultiply before decoding and premultiply the encoded
+// values again if alpha is kept. Runs of fully opaque pixels take the
+// straight path, and fully transparent pixels are stored as 0 when alpha
+// is kept.
+//
+// The SIMD kernels live in their own files, compiled with the instruction
+// set flags (see colorconvert.pri), and are selected at runtime by
+// convertPixels(). The helpers below are static so that each kernel file
+// gets its own copy instead of sharing one which may use newer instructions.
+// This covers these helpers only: inline functions from other headers
+// (qMin(), std::sqrt(), QImage accessors) are emitted as shared copies, and
+// the linker may keep the one compiled with AVX2. The helpers and kernels
+// therefore call no such functions, only intrinsics, each other, and the
+// out-of-line scalar kernels.
+
+struct RgbConversionParameters;
+typedef void (*RgbConversionKernel)(const QRgb *src, QRgb *const *dst, int count,
+                                    const RgbConversionParameters &parameters);
+
+struct RgbConversionParameters
+{
+    enum {
+        MaxHopCount = 4,
+        LinearFixedMax = 32767, // fixed-point linear 1.0
+        MatrixFixedShift = 12   // Q12 matrix
+    };
+    struct Hop
+    {
+        float matrix[9];            // row major
+        const float *toNonlinear;   // toNonlinearSize + 1 entries, indexed by sqrt(linear), scaled to 0..255
+    };
+
+    const float *toLinear;          // 256 entries
+    int toNonlinearSize;
+    bool preserveAlpha;
+    bool premultiplied;
+    int hopCount;
+    Hop hops[MaxHopCount];
+
+    // Kernel specialized for a single hop between two built-in color spaces
+    // with their default gamma, or null. Used when no SIMD kernel is available.
+    RgbConversionKernel builtinKernel;
+
+    // Fixed-point pipeline (ColorTransform::FixedPoint). Single hop only;
+    // replaces the float tables and matrix above when set.
+    bool fixedPoint;
+    const quint16 *toLinearFixed;   // 256 entries, scaled to 0..LinearFixedMax
+    const quint8 *toNonlinearFixed; // LinearFixedMax + 1 entries
+    const qint16 *matrixFixed;      // Q12, row major
+};
+
+RgbConversionParameters rgbConversionParameters(const RGBColorSpace &source, const RGBColorSpace &destination);
+RgbConversionParameters rgbConversionParameters(const ColorConversionChain &chain);
+RgbConversionParameters rgbConversionParameters(const ColorTransform &transform);
+
+void convertPixelsScalar(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters);
+void convertPixelsFixedScalar(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters);
+QRgb convertPixelFixedPremultiplied(QRgb pixel, const RgbConversionParameters &parameters);
+// Kernels available in this build. QT_COMPILER_SUPPORTS_* are set by
+// qconfig.h; a build which targets the instruction set anyway also has them.
+#if defined(Q_PROCESSOR_X86) && (defined(QT_COMPILER_SUPPORTS_SSE4_1) || defined(__SSE4_1__))
+#define COLORCONVERT_HAVE_SSE41
+#endif
+#if defined(Q_PROCESSOR_X86) && (defined(QT_COMPILER_SUPPORTS_AVX2) || defined(__AVX2__))
+#define COLORCONVERT_HAVE_AVX2
+#endif
+
+#ifdef COLORCONVERT_HAVE_SSE41
+void convertPixelsSse41(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters);
+void convertPixelsFixedSse41(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters);
+#endif
+#ifdef COLORCONVERT_HAVE_AVX2
+void convertPixelsAvx2(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters);
+#endif
+
+// Scalar kernel with the fused matrix of a built-in color space pair compiled
+// in, one specialization per pair. See convert<Source, Destination>().
+RgbConversionKernel builtinConversionKernel(RgbColorSpace source, RgbColorSpace destination);
+
+// Converts using the kernel for simdLevel().
+void convertPixels(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters);
+
+// Runs function(beginLine, endLine) over the lines [0, height) of an image
+// with the given width, split into bands of roughly cache-sized row ranges.
+// Bands are handed out to up to maxThreadCount threads (the calling thread
+// included) from the global QThreadPool. Returns when all bands are done.
+void forEachLineBand(int width, int height, int maxThreadCount,
+                     const std::function<void(int, int)> &function);
+
+// Float access to image lines, for the formats without 8-bit kernels:
+// RGBX64/RGBA64 (Qt 5.12) and the floating point formats (Qt 6.2). The
+// 32-bit formats are supported as well. unpackLine() reads count pixels
+// starting at offset as interleaved RGB and separate alpha; premultiplied
+// formats are unpremultiplied. packLine() does the reverse. Alpha is 1 for
+// formats without an alpha channel.
+bool isFloatPathFormat(QImage::Format format);
+bool hasFloatLineAccess(QImage::Format format);
+void unpackLine(const uchar *line, QImage::Format format, int offset, int count, float *rgb, float *alpha);
+void packLine(uchar *line, QImage::Format format, int offset, int count, const float *rgb, const float *alpha);
+
+// Runs convert() on image in convertibleImageFormat(): directly if that is
+// the image format, otherwise on a converted copy which is then converted
+// back. Null images are skipped.
+void convertInConvertibleFormat(QImage *image, const std::function<void(QImage *)> &convert);
+
+// Converts source to output (which may be the same image) through
+// convert(), which takes count interleaved RGB float triplets. Lines are
+// processed in chunks, in row bands as for forEachLineBand(). The output
+// alpha is copied from the source if preserveAlpha is set, and 1 otherwise.
+// The output is reallocated if it does not match the size and format of
+// source.
+void convertImageFloat(const QImage &source, QImage *output, bool preserveAlpha, int maxThreadCount,
+                       const std::function<void(const float *, float *, size_t)> &convert);
+
+// Scalar encode helper, shared by the kernel tails.
+static inline quint8 encodeNonlinear(float linear, const float *table, int tableSize)
+{
+    const float position = sqrtf(linear) * tableSize;
+    const int truncated = int(position);
+    const int index = (truncated < tableSize - 1) ? truncated : tableSize - 1;
+    const float fraction = position - index;
+    return quint8(table[index] + fraction * (table[index + 1] - table[index]) + 0.5f);
+}
+
+// Fixed-point matrix row times linear RGB: rounded, and clamped to
+// [0, LinearFixedMax]. The coefficients are limited to (-4, 4), which keeps
+// the sum within 32 bits.
+static inline int multiplyFixed(const qint16 *row, int r, int g, int b)
+{
+    const int value = (row[0] * r + row[1] * g + row[2] * b + (1 << (RgbConversionParameters::MatrixFixedShift - 1)))
+                      >> RgbConversionParameters::MatrixFixedShift;
+    return (value < 0) ? 0 : (value > RgbConversionParameters::LinearFixedMax)
+                             ? int(RgbConversionParameters::LinearFixedMax) : value;
+}
+
+// Premultiplied alpha: the unpremultiplied 8-bit value (the table index),
+// and the premultiplied encoded value. The SIMD kernels use the same float
+// operations, so the results match the scalar kernels exactly.
+static inline int unpremultiplyIndex(int value, int alpha)
+{
+    const int index = int(value * (255.0f / (alpha > 1 ? alpha : 1)) + 0.5f);
+    return (index < 255) ? index : 255;
+}
+
+static inline int premultiplyValue(int value, int alpha)
+{
+    return int(float(value * alpha) / 255.0f + 0.5f);
+}
+
+// Converts the tail of a SIMD kernel's input with the scalar kernel.
+static inline void convertPixelsTail(const QRgb *src, QRgb *const *dst, int offset, int count,
+                                     const RgbConversionParameters &parameters)
+{
+    if (offset == count)
+        return;
+    QRgb *tailDst[RgbConversionParameters::MaxHopCount];
+    for (int hop = 0; hop < parameters.hopCount; ++hop)
+        tailDst[hop] = dst[hop] ? dst[hop] + offset : nullptr;
+    if (parameters.fixedPoint)
+        convertPixelsFixedScalar(src + offset, tailDst, count - offset, parameters);
+    else
+        convertPixelsScalar(src + offset, tailDst, count - offset, parameters);
+}
+
+#endif
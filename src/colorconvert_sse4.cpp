@@ -0,0 +1,215 @@
+#include "colorconvert_p.h"
+
+#ifdef COLORCONVERT_HAVE_SSE41
+
+#include <smmintrin.h>
+
+// SSE4.1 kernel: converts four pixels per iteration. The table lookups are
+// scalar loads; the matrix, clamp and encode interpolation run on float lanes.
+
+static inline __m128 lookup4(const float *table, __m128i index)
+{
+    return _mm_setr_ps(table[_mm_extract_epi32(index, 0)],
+                       table[_mm_extract_epi32(index, 1)],
+                       table[_mm_extract_epi32(index, 2)],
+                       table[_mm_extract_epi32(index, 3)]);
+}
+
+static inline __m128i encode4(__m128 linear, const float *table, __m128 tableSize, __m128i maxIndex)
+{
+    const __m128 position = _mm_mul_ps(_mm_sqrt_ps(linear), tableSize);
+    const __m128i index = _mm_min_epi32(_mm_cvttps_epi32(position), maxIndex);
+    const __m128 fraction = _mm_sub_ps(position, _mm_cvtepi32_ps(index));
+    const __m128 t0 = lookup4(table, index);
+    const __m128 t1 = lookup4(table, _mm_add_epi32(index, _mm_set1_epi32(1)));
+    const __m128 value = _mm_add_ps(_mm_add_ps(t0, _mm_mul_ps(fraction, _mm_sub_ps(t1, t0))),
+                                    _mm_set1_ps(0.5f));
+    return _mm_cvttps_epi32(value);
+}
+
+// Premultiplied alpha, as unpremultiplyIndex() and premultiplyValue()
+static inline __m128i unpremultiply4(__m128i value, __m128 scale)
+{
+    const __m128 index = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(value), scale), _mm_set1_ps(0.5f));
+    return _mm_min_epi32(_mm_cvttps_epi32(index), _mm_set1_epi32(255));
+}
+
+static inline __m128i premultiply4(__m128i value, __m128i alpha)
+{
+    const __m128 product = _mm_cvtepi32_ps(_mm_mullo_epi32(value, alpha));
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(product, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+
+void convertPixelsSse41(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 tableSize = _mm_set1_ps(float(parameters.toNonlinearSize));
+    const __m128i maxIndex = _mm_set1_epi32(parameters.toNonlinearSize - 1);
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    // Alpha is either copied from the source (keep) or set to 255 (set)
+    const __m128i alphaKeep = _mm_set1_epi32(parameters.preserveAlpha ? int(0xff000000) : 0);
+    const __m128i alphaSet = _mm_set1_epi32(parameters.preserveAlpha ? 0 : int(0xff000000));
+
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i red = _mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask);
+        __m128i green = _mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask);
+        __m128i blue = _mm_and_si128(pixels, byteMask);
+
+        // Premultiplied pixels: opaque blocks take the straight path, fully
+        // transparent blocks are stored as 0 if alpha is kept, and other
+        // blocks are unpremultiplied
+        const __m128i sourceAlpha = _mm_srli_epi32(pixels, 24);
+        bool premultiply = false;
+        if (parameters.premultiplied && !_mm_test_all_ones(_mm_cmpeq_epi32(sourceAlpha, byteMask))) {
+            if (parameters.preserveAlpha && _mm_testz_si128(sourceAlpha, sourceAlpha)) {
+                for (int hop = 0; hop < parameters.hopCount; ++hop) {
+                    if (dst[hop])
+                        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[hop] + i), _mm_setzero_si128());
+                }
+                continue;
+            }
+            const __m128 scale = _mm_div_ps(_mm_set1_ps(255.0f),
+                                            _mm_cvtepi32_ps(_mm_max_epi32(sourceAlpha, _mm_set1_epi32(1))));
+            red = unpremultiply4(red, scale);
+            green = unpremultiply4(green, scale);
+            blue = unpremultiply4(blue, scale);
+            premultiply = parameters.preserveAlpha;
+        }
+
+        // Decode to linear RGB
+        const __m128 r = lookup4(parameters.toLinear, red);
+        const __m128 g = lookup4(parameters.toLinear, green);
+        const __m128 b = lookup4(parameters.toLinear, blue);
+
+        const __m128i alpha = _mm_or_si128(_mm_and_si128(pixels, alphaKeep), alphaSet);
+
+        __m128 dr = r, dg = g, db = b;
+        for (int hop = 0; hop < parameters.hopCount; ++hop) {
+            // Apply the conversion matrix and clamp
+            const float *m = parameters.hops[hop].matrix;
+            const __m128 sr = dr, sg = dg, sb = db;
+            dr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[0]), sr), _mm_mul_ps(_mm_set1_ps(m[1]), sg)),
+                            _mm_mul_ps(_mm_set1_ps(m[2]), sb));
+            dg = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[3]), sr), _mm_mul_ps(_mm_set1_ps(m[4]), sg)),
+                            _mm_mul_ps(_mm_set1_ps(m[5]), sb));
+            db = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(m[6]), sr), _mm_mul_ps(_mm_set1_ps(m[7]), sg)),
+                            _mm_mul_ps(_mm_set1_ps(m[8]), sb));
+            dr = _mm_min_ps(_mm_max_ps(dr, zero), one);
+            dg = _mm_min_ps(_mm_max_ps(dg, zero), one);
+            db = _mm_min_ps(_mm_max_ps(db, zero), one);
+
+            if (!dst[hop])
+                continue;
+
+            // Encode and repack
+            const float *table = parameters.hops[hop].toNonlinear;
+            __m128i er = encode4(dr, table, tableSize, maxIndex);
+            __m128i eg = encode4(dg, table, tableSize, maxIndex);
+            __m128i eb = encode4(db, table, tableSize, maxIndex);
+            if (premultiply) {
+                er = premultiply4(er, sourceAlpha);
+                eg = premultiply4(eg, sourceAlpha);
+                eb = premultiply4(eb, sourceAlpha);
+            }
+            __m128i result = _mm_or_si128(alpha, _mm_slli_epi32(er, 16));
+            result = _mm_or_si128(result, _mm_slli_epi32(eg, 8));
+            result = _mm_or_si128(result, eb);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst[hop] + i), result);
+        }
+    }
+
+    convertPixelsTail(src, dst, i, count, parameters);
+}
+
+// Fixed-point kernel: converts eight pixels per iteration, with the linear
+// values in 16-bit lanes. Each matrix row is evaluated with two
+// _mm_madd_epi16: (r, g) * (m0, m1) and (b, 1) * (m2, rounding).
+// Must match convertPixelsFixedScalar().
+
+static inline __m128i lookup8(const quint16 *table, const QRgb *pixels, int shift)
+{
+    return _mm_setr_epi16(table[(pixels[0] >> shift) & 0xff], table[(pixels[1] >> shift) & 0xff],
+                          table[(pixels[2] >> shift) & 0xff], table[(pixels[3] >> shift) & 0xff],
+                          table[(pixels[4] >> shift) & 0xff], table[(pixels[5] >> shift) & 0xff],
+                          table[(pixels[6] >> shift) & 0xff], table[(pixels[7] >> shift) & 0xff]);
+}
+
+static inline __m128i pair16(int low, int high)
+{
+    // Unsigned shift: the coefficients may be negative
+    return _mm_set1_epi32(int((quint32(high) << 16) | quint16(low)));
+}
+
+static inline __m128i multiplyRow8(__m128i rgLow, __m128i rgHigh, __m128i bOneLow, __m128i bOneHigh,
+                                   __m128i rowRG, __m128i rowBRound)
+{
+    const int shift = RgbConversionParameters::MatrixFixedShift;
+    const __m128i low = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rgLow, rowRG), _mm_madd_epi16(bOneLow, rowBRound)), shift);
+    const __m128i high = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rgHigh, rowRG), _mm_madd_epi16(bOneHigh, rowBRound)), shift);
+    // Saturating pack to [-32768, 32767] and clamp negative values to 0,
+    // which gives [0, LinearFixedMax]
+    return _mm_max_epi16(_mm_packs_epi32(low, high), _mm_setzero_si128());
+}
+
+void convertPixelsFixedSse41(const QRgb *src, QRgb *const *dst, int count, const RgbConversionParameters &parameters)
+{
+    static_assert(RgbConversionParameters::LinearFixedMax == 32767, "The kernel packs linear values to int16");
+
+    QRgb *out = dst[0];
+    const quint16 *toLinear = parameters.toLinearFixed;
+    const quint8 *toNonlinear = parameters.toNonlinearFixed;
+    const qint16 *m = parameters.matrixFixed;
+    const int rounding = 1 << (RgbConversionParameters::MatrixFixedShift - 1);
+    const __m128i rowRG[3] = { pair16(m[0], m[1]), pair16(m[3], m[4]), pair16(m[6], m[7]) };
+    const __m128i rowBRound[3] = { pair16(m[2], rounding), pair16(m[5], rounding), pair16(m[8], rounding) };
+    const __m128i one = _mm_set1_epi16(1);
+    const QRgb alphaKeep = parameters.preserveAlpha ? 0xff000000 : 0;
+    const QRgb alphaSet = parameters.preserveAlpha ? 0 : 0xff000000;
+
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const QRgb *pixels = src + i;
+
+        // Premultiplied blocks which are not fully opaque use the scalar kernel
+        if (parameters.premultiplied) {
+            const __m128i alpha0 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels)), 24);
+            const __m128i alpha1 = _mm_srli_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + 4)), 24);
+            const __m128i opaque = _mm_set1_epi32(255);
+            if (!_mm_test_all_ones(_mm_and_si128(_mm_cmpeq_epi32(alpha0, opaque), _mm_cmpeq_epi32(alpha1, opaque)))) {
+                QRgb *blockDst = out + i;
+                convertPixelsFixedScalar(pixels, &blockDst, 8, parameters);
+                continue;
+            }
+        }
+
+        // Decode to 15-bit linear RGB, interleaved as (r, g) and (b, 1) pairs
+        const __m128i r = lookup8(toLinear, pixels, 16);
+        const __m128i g = lookup8(toLinear, pixels, 8);
+        const __m128i b = lookup8(toLinear, pixels, 0);
+        const __m128i rgLow = _mm_unpacklo_epi16(r, g);
+        const __m128i rgHigh = _mm_unpackhi_epi16(r, g);
+        const __m128i bOneLow = _mm_unpacklo_epi16(b, one);
+        const __m128i bOneHigh = _mm_unpackhi_epi16(b, one);
+
+        quint16 linear[3][8];
+        for (int row = 0; row < 3; ++row) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(linear[row]),
+                             multiplyRow8(rgLow, rgHigh, bOneLow, bOneHigh, rowRG[row], rowBRound[row]));
+        }
+
+        // Encode and repack. Read the alpha before storing; out may be src.
+        for (int j = 0; j < 8; ++j) {
+            const QRgb alpha = (pixels[j] & alphaKeep) | alphaSet;
+            out[i + j] = alpha | (toNonlinear[linear[0][j]] << 16)
+                               | (toNonlinear[linear[1][j]] << 8)
+                               | toNonlinear[linear[2][j]];
+        }
+    }
+
+    convertPixelsTail(src, dst, i, count, parameters);
+}
+
+#endif // COLORCONVERT_HAVE_SSE41
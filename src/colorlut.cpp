@@ -0,0 +1,482 @@
+#include "colorlut.h"
+#include "colorconvert_p.h"
+#include "gamutmapping.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Grid position for each 8-bit input value: the lower grid index of the
+// cell containing the value, and the fraction towards the next grid point.
+struct LutInputTable
+{
+    int index[256];
+    float fraction[256];
+};
+
+static void createInputTable(LutInputTable *table, int size)
+{
+    for (int value = 0; value < 256; ++value) {
+        const float position = value * (size - 1) / 255.0f;
+        const int index = qMin(int(position), size - 2);
+        table->index[value] = index;
+        table->fraction[value] = position - index;
+    }
+}
+
+// Tetrahedral interpolation splits each grid cell into six tetrahedra which
+// share the diagonal from corner 000 to corner 111. The tetrahedron is
+// selected by the ordering of the fractions; the result is a weighted sum of
+// its four corners: 000, a, b and 111. Offsets are in floats from corner 000.
+struct LutStrides
+{
+    int r;
+    int g;
+    int b;
+};
+
+static inline void tetrahedron(float fr, float fg, float fb, const LutStrides &strides,
+                               int *a, int *b, float *weights)
+{
+    float f1, f2, f3;
+    if (fr >= fg) {
+        if (fg >= fb) {         // r > g > b
+            *a = strides.r;
+            *b = strides.r + strides.g;
+            f1 = fr; f2 = fg; f3 = fb;
+        } else if (fr >= fb) {  // r > b > g
+            *a = strides.r;
+            *b = strides.r + strides.b;
+            f1 = fr; f2 = fb; f3 = fg;
+        } else {                // b > r > g
+            *a = strides.b;
+            *b = strides.b + strides.r;
+            f1 = fb; f2 = fr; f3 = fg;
+        }
+    } else {
+        if (fb >= fg) {         // b > g > r
+            *a = strides.b;
+            *b = strides.b + strides.g;
+            f1 = fb; f2 = fg; f3 = fr;
+        } else if (fb >= fr) {  // g > b > r
+            *a = strides.g;
+            *b = strides.g + strides.b;
+            f1 = fg; f2 = fb; f3 = fr;
+        } else {                // g > r > b
+            *a = strides.g;
+            *b = strides.g + strides.r;
+            f1 = fg; f2 = fr; f3 = fb;
+        }
+    }
+    weights[0] = 1.0f - f1;
+    weights[1] = f1 - f2;
+    weights[2] = f2 - f3;
+    weights[3] = f3;
+}
+
+#ifdef __SSE2__
+static inline __m128 interpolate(const float *corner, int a, int b, int c, const float *weights)
+{
+    __m128 value = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(corner));
+    value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(weights[1]), _mm_loadu_ps(corner + a)));
+    value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(weights[2]), _mm_loadu_ps(corner + b)));
+    value = _mm_add_ps(value, _mm_mul_ps(_mm_set1_ps(weights[3]), _mm_loadu_ps(corner + c)));
+    return value;
+}
+#else
+static inline void interpolate(const float *corner, int a, int b, int c, const float *weights, float *rgb)
+{
+    for (int i = 0; i < 3; ++i)
+        rgb[i] = weights[0] * corner[i] + weights[1] * corner[a + i]
+               + weights[2] * corner[b + i] + weights[3] * corner[c + i];
+}
+#endif
+
+// Premultiplied pixels which are not opaque are unpremultiplied before the
+// lookup and premultiplied again after it, as in the 8-bit conversion kernels.
+static void lookupPixels(const float *table, int size, const LutInputTable &input,
+                         const QRgb *source, QRgb *destination, size_t count, bool premultiplied)
+{
+    const LutStrides strides = { 4, 4 * size, 4 * size * size };
+    const int diagonal = strides.r + strides.g + strides.b;
+#ifdef __SSE2__
+    const __m128 scale = _mm_set1_ps(255.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+#endif
+
+    for (size_t i = 0; i < count; ++i) {
+        QRgb pixel = source[i];
+        const int alpha = qAlpha(pixel);
+        const bool premultiply = premultiplied && alpha != 255;
+        if (premultiply) {
+            if (alpha == 0) {
+                destination[i] = 0;
+                continue;
+            }
+            pixel = qRgba(unpremultiplyIndex(qRed(pixel), alpha),
+                          unpremultiplyIndex(qGreen(pixel), alpha),
+                          unpremultiplyIndex(qBlue(pixel), alpha), alpha);
+        }
+        const int r = qRed(pixel);
+        const int g = qGreen(pixel);
+        const int b = qBlue(pixel);
+        const float *corner = table + input.index[r] * strides.r + input.index[g] * strides.g
+                                    + input.index[b] * strides.b;
+        int offsetA, offsetB;
+        float weights[4];
+        tetrahedron(input.fraction[r], input.fraction[g], input.fraction[b], strides, &offsetA, &offsetB, weights);
+
+#ifdef __SSE2__
+        // Scale to 0..255, reorder RGBX to the BGRX byte order of QRgb and
+        // pack with saturation.
+        const __m128 value = _mm_add_ps(_mm_mul_ps(interpolate(corner, offsetA, offsetB, diagonal, weights), scale), half);
+        __m128i packed = _mm_shuffle_epi32(_mm_cvttps_epi32(value), _MM_SHUFFLE(3, 0, 1, 2));
+        packed = _mm_packs_epi32(packed, packed);
+        packed = _mm_packus_epi16(packed, packed);
+        const QRgb rgb = QRgb(_mm_cvtsi128_si32(packed));
+        const QRgb result = (pixel & 0xff000000) | (rgb & 0x00ffffff);
+#else
+        float rgb[3];
+        interpolate(corner, offsetA, offsetB, diagonal, weights, rgb);
+        const QRgb result = qRgba(qBound(0, int(rgb[0] * 255.0f + 0.5f), 255),
+                                  qBound(0, int(rgb[1] * 255.0f + 0.5f), 255),
+                                  qBound(0, int(rgb[2] * 255.0f + 0.5f), 255),
+                                  alpha);
+#endif
+        if (premultiply) {
+            destination[i] = qRgba(premultiplyValue(qRed(result), alpha),
+                                   premultiplyValue(qGreen(result), alpha),
+                                   premultiplyValue(qBlue(result), alpha), alpha);
+        } else {
+            destination[i] = result;
+        }
+    }
+}
+
+ColorLut3D::ColorLut3D()
+:m_size(0)
+{
+
+}
+
+ColorLut3D::ColorLut3D(int size)
+:m_size(size)
+,m_table(size * size * size * 4)
+{
+    Q_ASSERT(size >= 2);
+
+    float *value = m_table.data();
+    for (int b = 0; b < size; ++b) {
+        for (int g = 0; g < size; ++g) {
+            for (int r = 0; r < size; ++r) {
+                value[0] = float(r) / (size - 1);
+                value[1] = float(g) / (size - 1);
+                value[2] = float(b) / (size - 1);
+                value[3] = 0.0f;
+                value += 4;
+            }
+        }
+    }
+}
+
+ColorLut3D ColorLut3D::fromFunction(const Function &function, int size)
+{
+    ColorLut3D lut(size);
+
+    // Evaluate the function at the grid points, one (g, b) row of the grid
+    // per line, in parallel. The function must be thread-safe.
+    const int rowCount = size * size;
+    QVector<float> rgb(rowCount * size * 3);
+    float *rgbData = rgb.data();
+    const float *grid = lut.m_table.constData();
+    forEachLineBand(size, rowCount, -1, [&](int begin, int end) {
+        const int offset = begin * size;
+        const int count = (end - begin) * size;
+        float *values = rgbData + offset * 3;
+        for (int i = 0; i < count; ++i) {
+            values[i * 3 + 0] = grid[(offset + i) * 4 + 0];
+            values[i * 3 + 1] = grid[(offset + i) * 4 + 1];
+            values[i * 3 + 2] = grid[(offset + i) * 4 + 2];
+        }
+        function(values, values, size_t(count));
+    });
+
+    float *table = lut.m_table.data();
+    for (int i = 0; i < rowCount * size; ++i) {
+        table[i * 4 + 0] = rgb.at(i * 3 + 0);
+        table[i * 4 + 1] = rgb.at(i * 3 + 1);
+        table[i * 4 + 2] = rgb.at(i * 3 + 2);
+    }
+    return lut;
+}
+
+ColorLut3D ColorLut3D::fromTransform(const ColorTransform &transform, int size)
+{
+    // Bake at full precision regardless of the transform's precision
+    const ColorTransform exact(transform.source(), transform.destination(), transform.flags(),
+                               ColorTransform::Exact);
+    ColorLut3D lut = fromFunction([&exact](const float *source, float *destination, size_t count) {
+        exact.apply(source, destination, count);
+    }, size);
+    lut.setTitle(transform.source().name() + " to " + transform.destination().name());
+    return lut;
+}
+
+ColorLut3D ColorLut3D::fromChain(const ColorConversionChain &chain, int size)
+{
+    // Bake at full precision regardless of the chain's precision
+    const ColorConversionChain exact(chain.colorSpaces(), ColorTransform::Exact);
+    return fromFunction([&exact](const float *source, float *destination, size_t count) {
+        exact.convert(source, destination, count);
+    }, size);
+}
+
+ColorLut3D ColorLut3D::fromGamutMapping(const GamutMapping &mapping, int size)
+{
+    ColorLut3D lut = fromFunction([&mapping](const float *source, float *destination, size_t count) {
+        mapping.apply(source, destination, count);
+    }, size);
+    lut.setTitle(mapping.source().name() + " to " + mapping.destination().name()
+                 + " (" + GamutMapping::strategyName(mapping.strategy()) + ")");
+    return lut;
+}
+
+bool ColorLut3D::isNull() const
+{
+    return m_size == 0;
+}
+
+int ColorLut3D::size() const
+{
+    return m_size;
+}
+
+QString ColorLut3D::title() const
+{
+    return m_title;
+}
+
+void ColorLut3D::setTitle(const QString &title)
+{
+    m_title = title;
+}
+
+void ColorLut3D::value(int r, int g, int b, float *rgb) const
+{
+    const float *value = m_table.constData() + ((b * m_size + g) * m_size + r) * 4;
+    rgb[0] = value[0];
+    rgb[1] = value[1];
+    rgb[2] = value[2];
+}
+
+void ColorLut3D::setValue(int r, int g, int b, const float *rgb)
+{
+    float *value = m_table.data() + ((b * m_size + g) * m_size + r) * 4;
+    value[0] = rgb[0];
+    value[1] = rgb[1];
+    value[2] = rgb[2];
+}
+
+void ColorLut3D::apply(QImage *image, int maxThreadCount) const
+{
+    if (isNull())
+        return;
+
+    if (convertibleImageFormat(*image) != image->format()) {
+        convertInConvertibleFormat(image, [=](QImage *converted) { apply(converted, maxThreadCount); });
+        return;
+    }
+
+    if (isFloatPathFormat(image->format())) {
+        convertImageFloat(*image, image, true, maxThreadCount,
+                          [this](const float *source, float *destination, size_t count) {
+            apply(source, destination, count);
+        });
+        return;
+    }
+
+    LutInputTable input;
+    createInputTable(&input, m_size);
+
+    const int width = image->width();
+    uchar *bits = image->bits();
+    const int bytesPerLine = image->bytesPerLine();
+    const float *table = m_table.constData();
+    const int size = m_size;
+    const bool premultiplied = (image->format() == QImage::Format_ARGB32_Premultiplied);
+
+    forEachLineBand(width, image->height(), maxThreadCount, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(bits + y * bytesPerLine);
+            lookupPixels(table, size, input, line, line, size_t(width), premultiplied);
+        }
+    });
+}
+
+void ColorLut3D::apply(const QRgb *source, QRgb *destination, size_t count) const
+{
+    if (isNull())
+        return;
+
+    LutInputTable input;
+    createInputTable(&input, m_size);
+    lookupPixels(m_table.constData(), m_size, input, source, destination, count, false);
+}
+
+void ColorLut3D::apply(const float *source, float *destination, size_t count) const
+{
+    if (isNull())
+        return;
+
+    const LutStrides strides = { 4, 4 * m_size, 4 * m_size * m_size };
+    const int diagonal = strides.r + strides.g + strides.b;
+    const float *table = m_table.constData();
+
+    for (size_t i = 0; i < count; ++i) {
+        int index[3];
+        float fraction[3];
+        for (int c = 0; c < 3; ++c) {
+            const float position = qBound(0.0f, source[i * 3 + c], 1.0f) * (m_size - 1);
+            index[c] = qMin(int(position), m_size - 2);
+            fraction[c] = position - index[c];
+        }
+        const float *corner = table + index[0] * strides.r + index[1] * strides.g + index[2] * strides.b;
+        int offsetA, offsetB;
+        float weights[4];
+        tetrahedron(fraction[0], fraction[1], fraction[2], strides, &offsetA, &offsetB, weights);
+
+#ifdef __SSE2__
+        float rgb[4];
+        _mm_storeu_ps(rgb, interpolate(corner, offsetA, offsetB, diagonal, weights));
+#else
+        float rgb[3];
+        interpolate(corner, offsetA, offsetB, diagonal, weights, rgb);
+#endif
+        destination[i * 3 + 0] = rgb[0];
+        destination[i * 3 + 1] = rgb[1];
+        destination[i * 3 + 2] = rgb[2];
+    }
+}
+
+QByteArray ColorLut3D::toCube() const
+{
+    QByteArray cube;
+    if (!m_title.isEmpty())
+        cube += "TITLE \"" + QString(m_title).remove('"').toUtf8() + "\"\n";
+    cube += "LUT_3D_SIZE " + QByteArray::number(m_size) + "\n\n";
+
+    const int count = m_size * m_size * m_size;
+    cube.reserve(cube.size() + count * 27);
+    char line[64];
+    for (int i = 0; i < count; ++i) {
+        const float *value = m_table.constData() + i * 4;
+        qsnprintf(line, sizeof(line), "%.6f %.6f %.6f\n", value[0], value[1], value[2]);
+        cube += line;
+    }
+    return cube;
+}
+
+ColorLut3D ColorLut3D::fromCube(const QByteArray &data, QString *errorString)
+{
+    auto fail = [errorString](int lineNumber, const QString &message) {
+        if (errorString)
+            *errorString = lineNumber > 0 ? QString("Line %1: %2").arg(lineNumber).arg(message) : message;
+        return ColorLut3D();
+    };
+
+    ColorLut3D lut;
+    QString title;
+    int count = 0;
+    const QList<QByteArray> lines = data.split('\n');
+    for (int i = 0; i < lines.count(); ++i) {
+        const int lineNumber = i + 1;
+        const QByteArray line = lines.at(i).trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        if (line.startsWith("TITLE")) {
+            QByteArray value = line.mid(5).trimmed();
+            if (value.startsWith('"') && value.endsWith('"') && value.size() >= 2)
+                value = value.mid(1, value.size() - 2);
+            title = QString::fromUtf8(value);
+            continue;
+        }
+
+        const QList<QByteArray> fields = line.simplified().split(' ');
+        const QByteArray keyword = fields.first();
+        if (keyword == "LUT_3D_SIZE") {
+            bool ok = false;
+            const int size = fields.count() == 2 ? fields.at(1).toInt(&ok) : 0;
+            if (!ok || size < 2 || size > 256)
+                return fail(lineNumber, QString("Invalid LUT_3D_SIZE"));
+            if (!lut.isNull())
+                return fail(lineNumber, QString("Duplicate LUT_3D_SIZE"));
+            lut = ColorLut3D(size);
+        } else if (keyword == "LUT_1D_SIZE") {
+            return fail(lineNumber, QString("1D LUTs are not supported"));
+        } else if (keyword == "DOMAIN_MIN" || keyword == "DOMAIN_MAX") {
+            // Only the default [0, 1] input domain is supported
+            const float expected = keyword == "DOMAIN_MIN" ? 0.0f : 1.0f;
+            if (fields.count() != 4)
+                return fail(lineNumber, QString("Invalid %1").arg(QString::fromLatin1(keyword)));
+            for (int c = 1; c < 4; ++c) {
+                if (fields.at(c).toFloat() != expected)
+                    return fail(lineNumber, QString("Only the [0, 1] input domain is supported"));
+            }
+        } else if (keyword == "LUT_3D_INPUT_RANGE") {
+            if (fields.count() != 3)
+                return fail(lineNumber, QString("Invalid LUT_3D_INPUT_RANGE"));
+            if (fields.at(1).toFloat() != 0.0f || fields.at(2).toFloat() != 1.0f)
+                return fail(lineNumber, QString("Only the [0, 1] input domain is supported"));
+        } else if (keyword.at(0) >= 'A' && keyword.at(0) <= 'Z') {
+            // Ignore unknown keywords
+        } else {
+            if (lut.isNull())
+                return fail(lineNumber, QString("Table data before LUT_3D_SIZE"));
+            if (count == lut.m_size * lut.m_size * lut.m_size)
+                return fail(lineNumber, QString("Too many table entries"));
+            if (fields.count() != 3)
+                return fail(lineNumber, QString("Expected three values"));
+
+            float *value = lut.m_table.data() + count * 4;
+            for (int c = 0; c < 3; ++c) {
+                bool ok = false;
+                value[c] = fields.at(c).toFloat(&ok);
+                if (!ok)
+                    return fail(lineNumber, QString("Invalid number \"%1\"").arg(QString::fromLatin1(fields.at(c))));
+            }
+            ++count;
+        }
+    }
+
+    if (lut.isNull())
+        return fail(0, QString("Missing LUT_3D_SIZE"));
+    const int expectedCount = lut.m_size * lut.m_size * lut.m_size;
+    if (count != expectedCount)
+        return fail(0, QString("Expected %1 table entries, found %2").arg(expectedCount).arg(count));
+
+    lut.setTitle(title);
+    return lut;
+}
+
+bool ColorLut3D::save(const QString &fileName, QString *errorString) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly) || file.write(toCube()) < 0) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+ColorLut3D ColorLut3D::load(const QString &fileName, QString *errorString)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return ColorLut3D();
+    }
+    return fromCube(file.readAll(), errorString);
+}
@@ -0,0 +1,74 @@
+#ifndef COLORLUT_H
+#define COLORLUT_H
+
+#include "colorconvert.h"
+
+class GamutMapping;
+
+// ColorLut3D is a 3D color lookup table: a size x size x size grid of output
+// RGB values sampled over the nonlinear [0, 1] input RGB cube. Applying the
+// table costs the same regardless of how expensive the baked conversion was,
+// which makes it a good fit for long conversion chains, gamut mapping, or
+// anything else that is too slow to evaluate per pixel.
+//
+// Values between grid points are computed with tetrahedral interpolation.
+// Common sizes are 17 (fast to bake), 33 (the default), and 65 (high quality).
+//
+// Tables can be read from and written to the .cube format (Adobe/Resolve
+// 3D LUT), with the default [0, 1] domain.
+
+class ColorLut3D
+{
+public:
+    enum { DefaultSize = 33 };
+
+    // Converts count interleaved RGB float triplets from source to
+    // destination. Used to sample the grid when baking.
+    typedef std::function<void(const float *source, float *destination, size_t count)> Function;
+
+    ColorLut3D();
+    explicit ColorLut3D(int size); // identity
+
+    static ColorLut3D fromFunction(const Function &function, int size = DefaultSize);
+    static ColorLut3D fromTransform(const ColorTransform &transform, int size = DefaultSize);
+    static ColorLut3D fromChain(const ColorConversionChain &chain, int size = DefaultSize);
+    static ColorLut3D fromGamutMapping(const GamutMapping &mapping, int size = DefaultSize);
+
+    bool isNull() const;
+    int size() const;
+
+    QString title() const;
+    void setTitle(const QString &title);
+
+    // Grid access. Indices are in [0, size).
+    void value(int r, int g, int b, float *rgb) const;
+    void setValue(int r, int g, int b, const float *rgb);
+
+    // Converts a 32-bit image (RGB32, ARGB32 or ARGB32_Premultiplied) in place,
+    // in parallel row bands as for RGBColorSpace::colorConvert(). Alpha is
+    // left unchanged. 16-bit and floating point images are converted at float
+    // precision, and images in other formats through convertibleImageFormat().
+    void apply(QImage *image, int maxThreadCount = -1) const;
+
+    // Converts count pixels with straight alpha from source to destination,
+    // which may be equal.
+    void apply(const QRgb *source, QRgb *destination, size_t count) const;
+
+    // Converts count interleaved RGB float triplets. Input values are
+    // clamped to [0, 1].
+    void apply(const float *source, float *destination, size_t count) const;
+
+    // .cube import and export. On failure the returned table is null and
+    // errorString (if set) describes the problem.
+    QByteArray toCube() const;
+    static ColorLut3D fromCube(const QByteArray &data, QString *errorString = nullptr);
+    bool save(const QString &fileName, QString *errorString = nullptr) const;
+    static ColorLut3D load(const QString &fileName, QString *errorString = nullptr);
+
+private:
+    int m_size;
+    QString m_title;
+    QVector<float> m_table; // RGBX, red index varies fastest
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef COLORMATRIX_H
+#define COLORMATRIX_H
+
+#include <QtCore>
+#include <QtGui>
+
+// Minimal constexpr 3-vector and 3x3 matrix types for color math. Unlike
+// QGenericMatrix they can be evaluated at compile time, which is used to
+// compute the matrices for the built-in color spaces without any static
+// initialization work at startup. Requires C++14.
+
+struct Vec3
+{
+    qreal v[3];
+
+    constexpr qreal operator[](int i) const { return v[i]; }
+};
+
+struct Mat3
+{
+    qreal m[9]; // row major
+
+    constexpr qreal operator()(int row, int column) const { return m[row * 3 + column]; }
+
+    static constexpr Mat3 identity() { return Mat3{{ 1, 0, 0, 0, 1, 0, 0, 0, 1 }}; }
+    static constexpr Mat3 diagonal(const Vec3 &d) { return Mat3{{ d[0], 0, 0, 0, d[1], 0, 0, 0, d[2] }}; }
+
+    QGenericMatrix<3, 3, qreal> toGenericMatrix() const { return QGenericMatrix<3, 3, qreal>(m); }
+    static Mat3 fromGenericMatrix(const QGenericMatrix<3, 3, qreal> &matrix)
+    {
+        Mat3 result = {};
+        for (int i = 0; i < 9; ++i)
+            result.m[i] = matrix(i / 3, i % 3);
+        return result;
+    }
+};
+
+constexpr Vec3 operator*(const Mat3 &a, const Vec3 &v)
+{
+    return Vec3{{ a(0, 0) * v[0] + a(0, 1) * v[1] + a(0, 2) * v[2],
+                  a(1, 0) * v[0] + a(1, 1) * v[1] + a(1, 2) * v[2],
+                  a(2, 0) * v[0] + a(2, 1) * v[1] + a(2, 2) * v[2] }};
+}
+
+constexpr Mat3 operator*(const Mat3 &a, const Mat3 &b)
+{
+    Mat3 result = {};
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 3; ++column) {
+            result.m[row * 3 + column] = a(row, 0) * b(0, column)
+                                       + a(row, 1) * b(1, column)
+                                       + a(row, 2) * b(2, column);
+        }
+    }
+    return result;
+}
+
+constexpr Mat3 inverted(const Mat3 &m)
+{
+    const qreal det = m(0, 0) * (m(1, 1) * m(2, 2) - m(2, 1) * m(1, 2)) -
+                      m(0, 1) * (m(1, 0) * m(2, 2) - m(1, 2) * m(2, 0)) +
+                      m(0, 2) * (m(1, 0) * m(2, 1) - m(1, 1) * m(2, 0));
+    const qreal invdet = qreal(1) / det;
+
+    return Mat3{{ (m(1, 1) * m(2, 2) - m(2, 1) * m(1, 2)) * invdet,
+                  (m(0, 2) * m(2, 1) - m(0, 1) * m(2, 2)) * invdet,
+                  (m(0, 1) * m(1, 2) - m(0, 2) * m(1, 1)) * invdet,
+                  (m(1, 2) * m(2, 0) - m(1, 0) * m(2, 2)) * invdet,
+                  (m(0, 0) * m(2, 2) - m(0, 2) * m(2, 0)) * invdet,
+                  (m(1, 0) * m(0, 2) - m(0, 0) * m(1, 2)) * invdet,
+                  (m(1, 0) * m(2, 1) - m(2, 0) * m(1, 1)) * invdet,
+                  (m(2, 0) * m(0, 1) - m(0, 0) * m(2, 1)) * invdet,
+                  (m(0, 0) * m(1, 1) - m(1, 0) * m(0, 1)) * invdet }};
+}
+
+// Derives the RGB -> XYZ normalized primary matrix (NPM) from the xy
+// chromaticities of the primaries and white point, as described in
+// SMPTE RP (Recommended Practice) 177.
+constexpr Mat3 deriveNPM(qreal rx, qreal ry, qreal gx, qreal gy, qreal bx, qreal by, qreal wx, qreal wy)
+{
+    // 3.3.2 Compute z
+    const qreal rz = 1 - (rx + ry);
+    const qreal gz = 1 - (gx + gy);
+    const qreal bz = 1 - (bx + by);
+    const qreal wz = 1 - (wx + wy);
+
+    // 3.3.3 Form P and W matrices
+    const Mat3 P = {{ rx, gx, bx,
+                      ry, gy, by,
+                      rz, gz, bz }};
+    const Vec3 W = {{ wx / wy, 1, wz / wy }};
+
+    // 3.3.4 Compute coefficients Ci
+    const Vec3 C = inverted(P) * W;
+
+    // 3.3.5 - 3.3.6 Form the diagonal matrix C and compute NPM = P * C
+    return P * Mat3::diagonal(C);
+}
+
+// Primaries and white point in { rx, ry, gx, gy, bx, by, wx, wy } form.
+constexpr Mat3 deriveNPM(const qreal (&rgbw_xy)[8])
+{
+    return deriveNPM(rgbw_xy[0], rgbw_xy[1], rgbw_xy[2], rgbw_xy[3],
+                     rgbw_xy[4], rgbw_xy[5], rgbw_xy[6], rgbw_xy[7]);
+}
+
+// The XYZ of RGB white (1, 1, 1), from an RGB -> XYZ matrix.
+constexpr Vec3 whiteXYZ(const Mat3 &RGBtoXYZ)
+{
+    return RGBtoXYZ * Vec3{{ 1, 1, 1 }};
+}
+
+// Cone response matrices for chromatic adaptation: Bradford (as used by ICC
+// profiles) and CAT02 (CIECAM02).
+static constexpr Mat3 bradfordConeResponse =
+    {{  0.8951,  0.2664, -0.1614,
+       -0.7502,  1.7135,  0.0367,
+        0.0389, -0.0685,  1.0296 }};
+
+static constexpr Mat3 cat02ConeResponse =
+    {{  0.7328,  0.4296, -0.1624,
+       -0.7036,  1.6975,  0.0061,
+        0.0030,  0.0136,  0.9834 }};
+
+// XYZ -> XYZ matrix which adapts colors seen under sourceWhite to the
+// corresponding colors under destinationWhite (both XYZ), by scaling the
+// cone responses (von Kries).
+constexpr Mat3 chromaticAdaptation(const Mat3 &coneResponse, const Vec3 &sourceWhite, const Vec3 &destinationWhite)
+{
+    const Vec3 source = coneResponse * sourceWhite;
+    const Vec3 destination = coneResponse * destinationWhite;
+    const Vec3 scale = {{ destination[0] / source[0], destination[1] / source[1], destination[2] / source[2] }};
+    return inverted(coneResponse) * Mat3::diagonal(scale) * coneResponse;
+}
+
+#endif
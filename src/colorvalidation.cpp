@@ -0,0 +1,108 @@
+#include "colorvalidation.h"
+#include "colorconvert_p.h"
+
+// Partial statistics for a range of colors, merged into the result.
+struct RoundTripAccumulator
+{
+    int maxError = 0;
+    QRgb worstInput = 0;
+    QRgb worstOutput = 0;
+    qint64 errorSum = 0;
+    qint64 colorCount = 0;
+    qint64 clippedCount = 0;
+
+    void merge(const RoundTripAccumulator &other)
+    {
+        // Ties go to the smaller input, which makes the worst case
+        // independent of the band order.
+        if (other.maxError > maxError || (other.maxError == maxError && other.worstInput < worstInput)) {
+            maxError = other.maxError;
+            worstInput = other.worstInput;
+            worstOutput = other.worstOutput;
+        }
+        errorSum += other.errorSum;
+        colorCount += other.colorCount;
+        clippedCount += other.clippedCount;
+    }
+};
+
+RoundTripStatistics measureRoundTrip(const RGBColorSpace &source, const RGBColorSpace &destination,
+                                     ColorTransform::Precision precision, int maxThreadCount)
+{
+    const ColorTransform there(source, destination, ColorTransform::NoFlags, precision);
+    const ColorTransform back(destination, source, ColorTransform::NoFlags, precision);
+
+    // Gamut test: the exact destination linear RGB, within the range which
+    // quantizes to 8-bit destination values. The slack keeps colors on the
+    // gamut boundary (white, and primaries shared by the two color spaces)
+    // inside, despite rounding in the matrices.
+    const QGenericMatrix<3, 3, qreal> matrix = RGBColorSpace::createRGBtoRGBMatrix(source, destination);
+    float matrixF[9];
+    for (int i = 0; i < 9; ++i)
+        matrixF[i] = float(matrix(i / 3, i % 3));
+    float toLinear[256];
+    const TransferFunction transferFunction = source.transferFunction();
+    for (int i = 0; i < 256; ++i)
+        toLinear[i] = float(transferFunction.toLinear(i / 255.0));
+    const TransferFunction destinationTransferFunction = destination.transferFunction();
+    const float low = -float(destinationTransferFunction.toLinear(0.5 / 255));
+    const float high = 2 - float(destinationTransferFunction.toLinear(254.5 / 255));
+
+    // One line per red and green value, with the 256 blue values.
+    RoundTripAccumulator result;
+    result.worstInput = 0xffffffff;
+    QMutex mutex;
+    forEachLineBand(256, 256 * 256, maxThreadCount, [&](int begin, int end) {
+        RoundTripAccumulator band;
+        band.worstInput = 0xffffffff;
+        QRgb input[256];
+        QRgb output[256];
+        for (int line = begin; line < end; ++line) {
+            const QRgb redGreen = 0xff000000 | (line << 8);
+            for (int blue = 0; blue < 256; ++blue)
+                input[blue] = redGreen | blue;
+            there.apply(input, output, 256);
+            back.apply(output, output, 256);
+
+            const float red = toLinear[line >> 8];
+            const float green = toLinear[line & 0xff];
+            for (int blue = 0; blue < 256; ++blue) {
+                const float rgb[3] = { red, green, toLinear[blue] };
+                bool clipped = false;
+                for (int row = 0; row < 3; ++row) {
+                    const float value = matrixF[row * 3] * rgb[0] + matrixF[row * 3 + 1] * rgb[1]
+                                        + matrixF[row * 3 + 2] * rgb[2];
+                    clipped |= (value < low || value > high);
+                }
+                if (clipped) {
+                    ++band.clippedCount;
+                    continue;
+                }
+
+                const QRgb in = input[blue];
+                const QRgb out = output[blue];
+                const int errors[3] = { qAbs(qRed(out) - qRed(in)), qAbs(qGreen(out) - qGreen(in)),
+                                        qAbs(qBlue(out) - qBlue(in)) };
+                const int error = qMax(errors[0], qMax(errors[1], errors[2]));
+                if (error > band.maxError || (error == band.maxError && in < band.worstInput)) {
+                    band.maxError = error;
+                    band.worstInput = in;
+                    band.worstOutput = out;
+                }
+                band.errorSum += errors[0] + errors[1] + errors[2];
+                ++band.colorCount;
+            }
+        }
+        QMutexLocker locker(&mutex);
+        result.merge(band);
+    });
+
+    RoundTripStatistics statistics;
+    statistics.maxError = result.maxError;
+    statistics.meanError = result.colorCount ? double(result.errorSum) / (result.colorCount * 3) : 0.0;
+    statistics.worstInput = (result.colorCount > 0) ? result.worstInput : 0;
+    statistics.worstOutput = result.worstOutput;
+    statistics.colorCount = result.colorCount;
+    statistics.clippedCount = result.clippedCount;
+    return statistics;
+}
@@ -0,0 +1,29 @@
+#ifndef COLORVALIDATION_H
+#define COLORVALIDATION_H
+
+#include "colorconvert.h"
+
+// Exhaustive round trip validation of the color conversions: all 2^24 8-bit
+// RGB colors are converted source -> destination -> source at a given
+// precision, and compared with the input. This gives the worst case error of
+// the 8-bit kernels (LUT, fixed point, SIMD) over the whole input domain.
+//
+// Colors outside the destination gamut clip and can not round trip; they are
+// counted, but not included in the error figures, which then measure the
+// conversion rather than the gamut difference.
+
+struct RoundTripStatistics
+{
+    int maxError = 0;           // largest channel difference, in 8-bit steps
+    double meanError = 0;       // mean channel difference
+    QRgb worstInput = 0;        // the first color (in RGB order) with maxError
+    QRgb worstOutput = 0;       // and what it round trips to
+    qint64 colorCount = 0;      // colors inside the destination gamut
+    qint64 clippedCount = 0;    // colors outside it
+};
+
+// Runs the sweep in parallel row bands as for RGBColorSpace::colorConvert().
+RoundTripStatistics measureRoundTrip(const RGBColorSpace &source, const RGBColorSpace &destination,
+                                     ColorTransform::Precision precision, int maxThreadCount = -1);
+
+#endif
@@ -0,0 +1,173 @@
+#include "gamutmapping.h"
+
+#include <cmath>
+
+// Oklab, from https://bottosson.github.io/posts/oklab/: XYZ (D65) to cone
+// response (LMS), and cube root LMS to Lab.
+static constexpr Mat3 XYZtoLMS = {{ 0.8189330101, 0.3618667424, -0.1288597137,
+                                    0.0329845436, 0.9293118715,  0.0361456387,
+                                    0.0482003018, 0.2643662691,  0.6338517070 }};
+static constexpr Mat3 LMStoLab = {{ 0.2104542553,  0.7936177850, -0.0040720468,
+                                    1.9779984951, -2.4285922050,  0.4505937099,
+                                    0.0259040371,  0.7827717662, -0.8086757660 }};
+static constexpr Mat3 LabtoLMS = inverted(LMStoLab);
+
+// Linear RGB components within this much of [0, 1] count as in gamut.
+static const qreal gamutTolerance = 1e-6;
+
+static bool isInUnitCube(const Vec3 &rgb)
+{
+    for (int c = 0; c < 3; ++c) {
+        if (rgb[c] < -gamutTolerance || rgb[c] > 1 + gamutTolerance)
+            return false;
+    }
+    return true;
+}
+
+static Vec3 cubeRoot(const Vec3 &v)
+{
+    return Vec3{{ std::cbrt(v[0]), std::cbrt(v[1]), std::cbrt(v[2]) }};
+}
+
+static Vec3 cube(const Vec3 &v)
+{
+    return Vec3{{ v[0] * v[0] * v[0], v[1] * v[1] * v[1], v[2] * v[2] * v[2] }};
+}
+
+GamutMapping::GamutMapping(const RGBColorSpace &source, const RGBColorSpace &destination, Strategy strategy,
+                           qreal knee)
+:m_source(source)
+,m_destination(destination)
+,m_strategy(strategy)
+,m_knee(qBound(qreal(0), knee, qreal(0.99)))
+{
+    m_sourceToDestination = Mat3::fromGenericMatrix(RGBColorSpace::createRGBtoRGBMatrix(source, destination));
+    m_destinationToSource = inverted(m_sourceToDestination);
+
+    // Scale LMS so that destination white is (1, 1, 1), which puts it at
+    // Lab (1, 0, 0) also for color spaces with other white points than D65.
+    const Mat3 toLMS = XYZtoLMS * Mat3::fromGenericMatrix(destination.RGBtoXYZMatrix());
+    const Vec3 white = toLMS * Vec3{{ 1, 1, 1 }};
+    m_destinationToLMS = Mat3::diagonal(Vec3{{ 1 / white[0], 1 / white[1], 1 / white[2] }}) * toLMS;
+    m_LMSToDestination = inverted(m_destinationToLMS);
+}
+
+RGBColorSpace GamutMapping::source() const
+{
+    return m_source;
+}
+
+RGBColorSpace GamutMapping::destination() const
+{
+    return m_destination;
+}
+
+GamutMapping::Strategy GamutMapping::strategy() const
+{
+    return m_strategy;
+}
+
+qreal GamutMapping::knee() const
+{
+    return m_knee;
+}
+
+QString GamutMapping::strategyName(Strategy strategy)
+{
+    switch (strategy) {
+    case Clip:
+        return QStringLiteral("clip");
+    case ChromaCompression:
+        return QStringLiteral("chroma compression");
+    case SoftKnee:
+        return QStringLiteral("soft knee");
+    }
+    return QString();
+}
+
+void GamutMapping::apply(const float *source, float *destination, size_t count) const
+{
+    const TransferFunction sourceTransfer = m_source.transferFunction();
+    const TransferFunction destinationTransfer = m_destination.transferFunction();
+    const Mat3 sourceToDestination = m_sourceToDestination;
+    const Mat3 destinationToSource = m_destinationToSource;
+    const Mat3 destinationToLMS = m_destinationToLMS;
+    const Mat3 LMSToDestination = m_LMSToDestination;
+
+    auto toLab = [&](const Vec3 &rgb) {
+        return LMStoLab * cubeRoot(destinationToLMS * rgb);
+    };
+    auto toRgb = [&](qreal L, qreal a, qreal b) {
+        return LMSToDestination * cube(LabtoLMS * Vec3{{ L, a, b }});
+    };
+
+    // The largest chroma at lightness L and hue (ca, cb) (a unit vector)
+    // for which the destination linear RGB is inside the destination gamut,
+    // or the source gamut if inSource is set.
+    auto boundaryChroma = [&](qreal L, qreal ca, qreal cb, bool inSource) {
+        auto isInside = [&](qreal chroma) {
+            const Vec3 rgb = toRgb(L, chroma * ca, chroma * cb);
+            return isInUnitCube(inSource ? destinationToSource * rgb : rgb);
+        };
+        qreal low = 0;
+        qreal high = 0.5;
+        while (isInside(high) && high < 8) {
+            low = high;
+            high *= 2;
+        }
+        for (int i = 0; i < 24; ++i) {
+            const qreal middle = (low + high) / 2;
+            if (isInside(middle))
+                low = middle;
+            else
+                high = middle;
+        }
+        return low;
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        const Vec3 sourceLinear = {{ sourceTransfer.toLinear(qBound(0.0f, source[i * 3 + 0], 1.0f)),
+                                     sourceTransfer.toLinear(qBound(0.0f, source[i * 3 + 1], 1.0f)),
+                                     sourceTransfer.toLinear(qBound(0.0f, source[i * 3 + 2], 1.0f)) }};
+        Vec3 rgb = sourceToDestination * sourceLinear;
+
+        if (m_strategy != Clip) {
+            const Vec3 Lab = toLab(rgb);
+            const qreal L = qBound(qreal(0), Lab[0], qreal(1));
+            const qreal chroma = std::hypot(Lab[1], Lab[2]);
+            if (chroma < 1e-9) {
+                rgb = toRgb(L, 0, 0);
+            } else {
+                const qreal ca = Lab[1] / chroma;
+                const qreal cb = Lab[2] / chroma;
+                const qreal destinationChroma = boundaryChroma(L, ca, cb, false);
+                if (destinationChroma <= 0) {
+                    rgb = toRgb(L, 0, 0);
+                } else {
+                    // Chroma relative to the destination boundary; the
+                    // source boundary is at sourceRatio.
+                    const qreal ratio = chroma / destinationChroma;
+                    const qreal sourceRatio = qMax(boundaryChroma(L, ca, cb, true), chroma) / destinationChroma;
+                    qreal mappedRatio = ratio;
+                    if (sourceRatio > 1) {
+                        if (m_strategy == ChromaCompression) {
+                            mappedRatio = ratio / sourceRatio;
+                        } else if (ratio > m_knee) {
+                            // A rational curve from the knee to the boundary,
+                            // with slope 1 at the knee (no visible edge in
+                            // gradients) which maps sourceRatio to 1.
+                            const qreal slope = (sourceRatio - m_knee) / (1 - m_knee);
+                            const qreal x = qMin((ratio - m_knee) / (sourceRatio - m_knee), qreal(1));
+                            mappedRatio = m_knee + (1 - m_knee) * slope * x / (1 + (slope - 1) * x);
+                        }
+                    }
+                    const qreal mappedChroma = mappedRatio * destinationChroma;
+                    rgb = toRgb(L, mappedChroma * ca, mappedChroma * cb);
+                }
+            }
+        }
+
+        for (int c = 0; c < 3; ++c)
+            destination[i * 3 + c] = float(destinationTransfer.toNonlinear(qBound(qreal(0), rgb[c], qreal(1))));
+    }
+}
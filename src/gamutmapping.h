@@ -0,0 +1,60 @@
+#ifndef GAMUTMAPPING_H
+#define GAMUTMAPPING_H
+
+#include "colorconvert.h"
+#include "colormatrix.h"
+
+// GamutMapping converts colors from a source to a destination color space,
+// bringing colors outside the destination gamut inside it with one of these
+// strategies:
+//    - Clip: clamps linear RGB, as ColorTransform does. Saturated colors
+//      beyond the boundary collapse onto it, which posterizes gradients.
+//    - ChromaCompression: scales chroma so that the source gamut boundary
+//      lands on the destination boundary, for each lightness and hue. All
+//      colors are desaturated in proportion, and differences are kept.
+//    - SoftKnee: leaves colors up to knee (a fraction of the destination
+//      boundary chroma) unchanged, and compresses the range from there to
+//      the source boundary smoothly into the rest of the destination gamut.
+//
+// Chroma is compressed at constant lightness and hue in Oklab, normalized
+// to the destination white point. The boundaries are found by bisection,
+// which is far too slow to run per pixel: bake the mapping into a
+// ColorLut3D with ColorLut3D::fromGamutMapping(), which costs the same per
+// pixel regardless of the strategy.
+
+class GamutMapping
+{
+public:
+    enum Strategy {
+        Clip,
+        ChromaCompression,
+        SoftKnee
+    };
+
+    GamutMapping(const RGBColorSpace &source, const RGBColorSpace &destination, Strategy strategy = SoftKnee,
+                 qreal knee = 0.8);
+
+    RGBColorSpace source() const;
+    RGBColorSpace destination() const;
+    Strategy strategy() const;
+    qreal knee() const;
+
+    static QString strategyName(Strategy strategy);
+
+    // Maps count interleaved nonlinear RGB triplets with components in
+    // [0, 1]. source and destination may be equal. Thread-safe.
+    void apply(const float *source, float *destination, size_t count) const;
+
+private:
+    RGBColorSpace m_source;
+    RGBColorSpace m_destination;
+    Strategy m_strategy;
+    qreal m_knee;
+
+    Mat3 m_sourceToDestination;     // linear RGB
+    Mat3 m_destinationToSource;
+    Mat3 m_destinationToLMS;        // white balanced Oklab LMS
+    Mat3 m_LMSToDestination;
+};
+
+#endif
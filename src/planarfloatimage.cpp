@@ -0,0 +1,170 @@
+#include "planarfloatimage.h"
+#include "colorconvert_p.h"
+
+PlanarFloatImage::PlanarFloatImage()
+:m_width(0)
+,m_height(0)
+,m_hasAlpha(false)
+{
+
+}
+
+PlanarFloatImage::PlanarFloatImage(int width, int height, bool hasAlpha)
+:m_width(width)
+,m_height(height)
+,m_hasAlpha(hasAlpha)
+{
+    m_data.resize(width * height * (hasAlpha ? 4 : 3));
+}
+
+// The format to read or write an image of the given format through: the
+// format itself if there is float line access for it, otherwise the
+// widest format the channels fit in. Qt converts between the two.
+static QImage::Format floatAccessFormat(QImage::Format format)
+{
+    if (hasFloatLineAccess(format))
+        return format;
+    const QPixelFormat pixelFormat = QImage::toPixelFormat(format);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 2, 0)
+    if (pixelFormat.typeInterpretation() == QPixelFormat::FloatingPoint)
+        return QImage::Format_RGBA32FPx4;
+#endif
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    if (pixelFormat.redSize() > 8)
+        return QImage::Format_RGBA64;
+#endif
+    Q_UNUSED(pixelFormat);
+    return QImage::Format_ARGB32;
+}
+
+PlanarFloatImage PlanarFloatImage::fromImage(const QImage &image)
+{
+    if (image.isNull())
+        return PlanarFloatImage();
+
+    const QImage::Format format = floatAccessFormat(image.format());
+    const QImage source = (format == image.format()) ? image : image.convertToFormat(format);
+
+    const int width = source.width();
+    PlanarFloatImage result(width, source.height(), source.hasAlphaChannel());
+    const int chunkSize = 256;
+    float rgb[chunkSize * 3];
+    float alpha[chunkSize];
+    for (int y = 0; y < result.m_height; ++y) {
+        const uchar *line = source.constScanLine(y);
+        for (int x = 0; x < width; x += chunkSize) {
+            const int count = qMin(chunkSize, width - x);
+            unpackLine(line, format, x, count, rgb, alpha);
+            float *planes[] = { result.scanLine(Red, y) + x, result.scanLine(Green, y) + x,
+                                result.scanLine(Blue, y) + x };
+            for (int i = 0; i < count; ++i) {
+                for (int c = 0; c < 3; ++c)
+                    planes[c][i] = rgb[i * 3 + c];
+            }
+            if (result.m_hasAlpha)
+                std::copy(alpha, alpha + count, result.scanLine(Alpha, y) + x);
+        }
+    }
+    return result;
+}
+
+QImage PlanarFloatImage::toImage(QImage::Format format) const
+{
+    if (isNull())
+        return QImage();
+
+    const QImage::Format accessFormat = floatAccessFormat(format);
+    QImage image(m_width, m_height, accessFormat);
+    const int chunkSize = 256;
+    float rgb[chunkSize * 3];
+    float alpha[chunkSize];
+    for (int y = 0; y < m_height; ++y) {
+        uchar *line = image.scanLine(y);
+        for (int x = 0; x < m_width; x += chunkSize) {
+            const int count = qMin(chunkSize, m_width - x);
+            const float *planes[] = { constScanLine(Red, y) + x, constScanLine(Green, y) + x,
+                                      constScanLine(Blue, y) + x };
+            for (int i = 0; i < count; ++i) {
+                for (int c = 0; c < 3; ++c)
+                    rgb[i * 3 + c] = planes[c][i];
+            }
+            if (m_hasAlpha)
+                std::copy(constScanLine(Alpha, y) + x, constScanLine(Alpha, y) + x + count, alpha);
+            else
+                std::fill(alpha, alpha + count, 1.0f);
+            packLine(line, accessFormat, x, count, rgb, alpha);
+        }
+    }
+    return (accessFormat == format) ? image : image.convertToFormat(format);
+}
+
+bool PlanarFloatImage::isNull() const
+{
+    return m_data.isEmpty();
+}
+
+int PlanarFloatImage::width() const
+{
+    return m_width;
+}
+
+int PlanarFloatImage::height() const
+{
+    return m_height;
+}
+
+bool PlanarFloatImage::hasAlpha() const
+{
+    return m_hasAlpha;
+}
+
+float *PlanarFloatImage::scanLine(Channel channel, int y)
+{
+    Q_ASSERT(channel != Alpha || m_hasAlpha);
+    return m_data.data() + (channel * m_height + y) * m_width;
+}
+
+const float *PlanarFloatImage::constScanLine(Channel channel, int y) const
+{
+    Q_ASSERT(channel != Alpha || m_hasAlpha);
+    return m_data.constData() + (channel * m_height + y) * m_width;
+}
+
+void PlanarFloatImage::convertRgb(const std::function<void(const float *, float *, size_t)> &convert,
+                                  int maxThreadCount)
+{
+    if (isNull())
+        return;
+
+    // Resolve the planes before starting threads: data() may detach.
+    float *data = m_data.data();
+    const int width = m_width;
+    const int planeSize = m_width * m_height;
+
+    forEachLineBand(width, m_height, maxThreadCount, [&](int begin, int end) {
+        const int chunkSize = 256;
+        float rgb[chunkSize * 3];
+        for (int y = begin; y < end; ++y) {
+            float *planes[] = { data + y * width, data + planeSize + y * width,
+                                data + 2 * planeSize + y * width };
+            for (int x = 0; x < width; x += chunkSize) {
+                const int count = qMin(chunkSize, width - x);
+                for (int i = 0; i < count; ++i) {
+                    for (int c = 0; c < 3; ++c)
+                        rgb[i * 3 + c] = planes[c][x + i];
+                }
+                convert(rgb, rgb, size_t(count));
+                for (int i = 0; i < count; ++i) {
+                    for (int c = 0; c < 3; ++c)
+                        planes[c][x + i] = rgb[i * 3 + c];
+                }
+            }
+        }
+    });
+}
+
+void PlanarFloatImage::fillAlpha(float alpha)
+{
+    if (m_hasAlpha)
+        std::fill(scanLine(Alpha, 0), scanLine(Alpha, 0) + m_width * m_height, alpha);
+}
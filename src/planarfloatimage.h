@@ -0,0 +1,61 @@
+#ifndef PLANARFLOATIMAGE_H
+#define PLANARFLOATIMAGE_H
+
+#include <QtCore>
+#include <QtGui>
+
+#include <functional>
+
+// PlanarFloatImage is an RGB(A) image with one float32 plane per channel.
+// Alpha is not premultiplied. Values are nominally in [0, 1]; conversions
+// clamp their input.
+//
+// Converting in this form keeps full precision between stages, for example
+// when applying several transforms in sequence, instead of quantizing to
+// 8 or 16 bits after each one. See ColorTransform::apply() and
+// ColorConversionChain::convert().
+
+class PlanarFloatImage
+{
+public:
+    enum Channel {
+        Red,
+        Green,
+        Blue,
+        Alpha
+    };
+
+    PlanarFloatImage();
+    PlanarFloatImage(int width, int height, bool hasAlpha = true);
+
+    // Reads any QImage format. 16-bit formats, and floating point formats
+    // with Qt 6.2, keep their precision; other formats are read as 8-bit.
+    static PlanarFloatImage fromImage(const QImage &image);
+    QImage toImage(QImage::Format format) const;
+
+    bool isNull() const;
+    int width() const;
+    int height() const;
+    bool hasAlpha() const;
+
+    // Rows are width() floats long. The Alpha channel is only available if
+    // hasAlpha() is set.
+    float *scanLine(Channel channel, int y);
+    const float *constScanLine(Channel channel, int y) const;
+
+    // Converts the RGB planes in place, in parallel row bands as for
+    // RGBColorSpace::colorConvert(). convert() takes count interleaved RGB
+    // triplets and may be called from several threads at once.
+    void convertRgb(const std::function<void(const float *, float *, size_t)> &convert,
+                    int maxThreadCount = -1);
+
+    void fillAlpha(float alpha);
+
+private:
+    int m_width;
+    int m_height;
+    bool m_hasAlpha;
+    QVector<float> m_data; // planes in channel order
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "transferfunction.h"
+
+TransferFunction::TransferFunction()
+:TransferFunction(1, 1, 0, 0, 0)
+{
+
+}
+
+TransferFunction::TransferFunction(qreal g, qreal a, qreal b, qreal c, qreal d, qreal e, qreal f)
+:m_g(g)
+,m_a(a)
+,m_b(b)
+,m_c(c)
+,m_d(d)
+,m_e(e)
+,m_f(f)
+{
+    updateInverse();
+}
+
+TransferFunction::TransferFunction(const std::function<qreal(qreal)> &toLinear,
+                                   const std::function<qreal(qreal)> &toNonlinear)
+:TransferFunction()
+{
+    m_custom.reset(new CustomFunctions{ toLinear, toNonlinear });
+}
+
+TransferFunction TransferFunction::fromGamma(qreal gamma)
+{
+    return TransferFunction(gamma, 1, 0, 0, 0);
+}
+
+void TransferFunction::updateInverse()
+{
+    m_linearD = m_c * m_d + m_f;
+    m_inverseC = (m_c != 0) ? 1 / m_c : 0;
+
+    const qreal parameters[] = { m_g, m_a, m_b, m_c, m_d, m_e, m_f };
+    for (int i = 0; i < 7; ++i)
+        m_floatParameters[i] = float(parameters[i]);
+    m_floatInverseG = float(1 / m_g);
+    m_floatLinearD = float(m_linearD);
+    m_floatInverseC = float(m_inverseC);
+}
+
+bool TransferFunction::isCustom() const
+{
+    return !m_custom.isNull();
+}
+
+bool TransferFunction::isGamma() const
+{
+    return !m_custom && m_a == 1 && m_b == 0 && m_d == 0 && m_e == 0 && m_f == 0;
+}
+
+qreal TransferFunction::toLinear(qreal x) const
+{
+    if (m_custom)
+        return m_custom->toLinear(x);
+
+    if (x >= m_d)
+        return qPow(qMax(m_a * x + m_b, qreal(0)), m_g) + m_e;
+    return m_c * x + m_f;
+}
+
+qreal TransferFunction::toNonlinear(qreal y) const
+{
+    if (m_custom)
+        return m_custom->toNonlinear(y);
+
+    if (y >= m_linearD)
+        return (qPow(qMax(y - m_e, qreal(0)), 1 / m_g) - m_b) / m_a;
+    return (y - m_f) * m_inverseC;
+}
+
+// The parameters are copied to locals, so that the compiler can keep them
+// in registers and vectorize the loops without checking for aliasing with
+// result.
+void TransferFunction::toLinearApproximate(const float *values, float *result, size_t count) const
+{
+    if (m_custom) {
+        for (size_t i = 0; i < count; ++i)
+            result[i] = float(m_custom->toLinear(values[i]));
+        return;
+    }
+
+    float p[7];
+    std::copy(m_floatParameters, m_floatParameters + 7, p);
+    for (size_t i = 0; i < count; ++i)
+        result[i] = parametricToLinear(values[i], p);
+}
+
+void TransferFunction::toNonlinearApproximate(const float *values, float *result, size_t count) const
+{
+    if (m_custom) {
+        for (size_t i = 0; i < count; ++i)
+            result[i] = float(m_custom->toNonlinear(values[i]));
+        return;
+    }
+
+    float p[7];
+    std::copy(m_floatParameters, m_floatParameters + 7, p);
+    const float inverseG = m_floatInverseG;
+    const float linearD = m_floatLinearD;
+    const float inverseC = m_floatInverseC;
+    for (size_t i = 0; i < count; ++i)
+        result[i] = parametricToNonlinear(values[i], p, inverseG, linearD, inverseC);
+}
+
+bool TransferFunction::operator==(const TransferFunction &other) const
+{
+    if (m_custom || other.m_custom)
+        return m_custom == other.m_custom;
+
+    return m_g == other.m_g && m_a == other.m_a && m_b == other.m_b && m_c == other.m_c
+        && m_d == other.m_d && m_e == other.m_e && m_f == other.m_f;
+}
+
+bool TransferFunction::operator!=(const TransferFunction &other) const
+{
+    return !(*this == other);
+}
+
+uint qHash(const TransferFunction &transferFunction, uint seed)
+{
+    if (transferFunction.m_custom)
+        return qHash(transferFunction.m_custom.data(), seed);
+
+    seed = qHash(transferFunction.m_g, seed);
+    seed = qHash(transferFunction.m_a, seed);
+    seed = qHash(transferFunction.m_b, seed);
+    seed = qHash(transferFunction.m_c, seed);
+    seed = qHash(transferFunction.m_d, seed);
+    seed = qHash(transferFunction.m_e, seed);
+    return qHash(transferFunction.m_f, seed);
+}
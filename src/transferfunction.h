@@ -0,0 +1,176 @@
+#ifndef TRANSFERFUNCTION_H
+#define TRANSFERFUNCTION_H
+
+#include <QtCore>
+
+#include <cstring>
+#include <functional>
+
+// TransferFunction maps nonlinear (encoded) color values to linear light and
+// back. It is either a parametric curve in the ICC parametric curve form
+//
+//     linear = (a * x + b)^g + e    for x >= d
+//     linear = c * x + f            for x < d
+//
+// which covers pure power curves ("gamma") and the piecewise curves used by
+// sRGB and Rec.709/2020, or a custom pair of functions.
+//
+// Each curve can be evaluated three ways:
+//    - toLinear()/toNonlinear(): exact, at double precision.
+//    - toLinearApproximate()/toNonlinearApproximate(): float, using a fast
+//      branch-free pow() approximation (relative error < 3e-6). The array
+//      overloads select the curve once per call, so that their loops
+//      vectorize. Custom functions fall back to the exact path.
+//    - as lookup tables, see RGBColorSpace::toLinear(quint8).
+
+class TransferFunction
+{
+public:
+    TransferFunction(); // linear
+    TransferFunction(qreal g, qreal a, qreal b, qreal c, qreal d, qreal e = 0, qreal f = 0);
+    TransferFunction(const std::function<qreal(qreal)> &toLinear,
+                     const std::function<qreal(qreal)> &toNonlinear);
+
+    static TransferFunction fromGamma(qreal gamma);
+
+    bool isCustom() const;
+    bool isGamma() const; // pure power curve
+
+    qreal toLinear(qreal value) const;
+    qreal toNonlinear(qreal value) const;
+
+    float toLinearApproximate(float value) const;
+    float toNonlinearApproximate(float value) const;
+
+    // Converts count values; values and result may be equal.
+    void toLinearApproximate(const float *values, float *result, size_t count) const;
+    void toNonlinearApproximate(const float *values, float *result, size_t count) const;
+
+    // Custom functions compare equal only to copies of themselves.
+    bool operator==(const TransferFunction &other) const;
+    bool operator!=(const TransferFunction &other) const;
+
+private:
+    friend uint qHash(const TransferFunction &transferFunction, uint seed);
+
+    struct CustomFunctions
+    {
+        std::function<qreal(qreal)> toLinear;
+        std::function<qreal(qreal)> toNonlinear;
+    };
+
+    void updateInverse();
+
+    // The parametric curves in float, with p = { g, a, b, c, d, e, f }
+    static inline float parametricToLinear(float x, const float *p);
+    static inline float parametricToNonlinear(float y, const float *p, float inverseG, float linearD,
+                                              float inverseC);
+
+    qreal m_g, m_a, m_b, m_c, m_d, m_e, m_f;
+    qreal m_linearD;    // d in the linear domain, the break point for toNonlinear
+    qreal m_inverseC;   // 1 / c, or 0 for a pure power curve
+    QSharedPointer<const CustomFunctions> m_custom;
+
+    // float copies for the approximate functions
+    float m_floatParameters[7];
+    float m_floatInverseG, m_floatLinearD, m_floatInverseC;
+};
+
+uint qHash(const TransferFunction &transferFunction, uint seed = 0);
+
+// Fast float log2, exp2 and pow approximations. Branch-free so that loops
+// using them vectorize.
+
+// condition ? a : b, with bit masks. Compilers keep a float select which
+// guards a conversion or a division as a branch (those may trap), which
+// stops the loop from vectorizing.
+inline float selectFloat(bool condition, float a, float b)
+{
+    const qint32 mask = -qint32(condition);
+    qint32 aBits, bBits;
+    std::memcpy(&aBits, &a, sizeof(aBits));
+    std::memcpy(&bBits, &b, sizeof(bBits));
+    const qint32 bits = (aBits & mask) | (bBits & ~mask);
+    float result;
+    std::memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+inline float maxFloat(float a, float b)
+{
+    return selectFloat(a < b, b, a);
+}
+
+// log2(x) for x > 0. Absolute error < 1e-7.
+inline float fastLog2(float x)
+{
+    // Split x into 2^exponent * m with m in [sqrt(1/2), sqrt(2))
+    qint32 bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    const qint32 offset = bits - 0x3f3504f3; // sqrt(1/2)
+    const qint32 exponent = offset >> 23;
+    const qint32 mantissaBits = bits - (exponent << 23);
+    float m;
+    std::memcpy(&m, &mantissaBits, sizeof(m));
+
+    // log2(m) = 2 / ln(2) * atanh(s), with s = (m - 1) / (m + 1) in [-0.172, 0.172]
+    const float s = (m - 1.0f) / (m + 1.0f);
+    const float s2 = s * s;
+    const float p = 2.88539008f + s2 * (0.961796694f + s2 * (0.577078016f + s2 * 0.412198583f));
+    return float(exponent) + s * p;
+}
+
+// 2^x. Relative error < 2e-7. Results below 2^-126 are flushed to 2^-126.
+inline float fastExp2(float x)
+{
+    x = selectFloat(x < -126.0f, -126.0f, selectFloat(x > 127.0f, 127.0f, x));
+    qint32 integer = qint32(x);
+    integer -= qint32(x < float(integer)); // floor
+    const float f = x - float(integer);
+
+    // 2^f for f in [0, 1)
+    const float p = 1.0f + f * (0.693151363f + f * (0.240164153f + f * (0.0558004481f
+                  + f * (0.00901668637f + f * 0.00186718339f))));
+
+    const qint32 scaleBits = (integer + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &scaleBits, sizeof(scale));
+    return p * scale;
+}
+
+// x^y for x >= 0.
+inline float fastPow(float x, float y)
+{
+    return fastExp2(y * fastLog2(maxFloat(x, 1.17549435e-38f)));
+}
+
+inline float TransferFunction::parametricToLinear(float x, const float *p)
+{
+    const float curve = fastPow(maxFloat(p[1] * x + p[2], 0.0f), p[0]) + p[5];
+    const float line = p[3] * x + p[6];
+    return selectFloat(x >= p[4], curve, line);
+}
+
+inline float TransferFunction::parametricToNonlinear(float y, const float *p, float inverseG, float linearD,
+                                                     float inverseC)
+{
+    const float curve = (fastPow(maxFloat(y - p[5], 0.0f), inverseG) - p[2]) / p[1];
+    const float line = (y - p[6]) * inverseC;
+    return selectFloat(y >= linearD, curve, line);
+}
+
+inline float TransferFunction::toLinearApproximate(float x) const
+{
+    if (m_custom)
+        return float(toLinear(x));
+    return parametricToLinear(x, m_floatParameters);
+}
+
+inline float TransferFunction::toNonlinearApproximate(float y) const
+{
+    if (m_custom)
+        return float(toNonlinear(y));
+    return parametricToNonlinear(y, m_floatParameters, m_floatInverseG, m_floatLinearD, m_floatInverseC);
+}
+
+#endif
@@ -0,0 +1,12 @@
+TEMPLATE = app
+
+TARGET = tst_colorconvert
+include(../../src/colorconvert.pri)
+
+SOURCES += tst_colorconvert.cpp
+
+QT = core gui testlib
+CONFIG += testcase console
+CONFIG -= app_bundle
+OBJECTS_DIR = .obj
+MOC_DIR = .moc
@@ -0,0 +1,875 @@
+#include <QtTest>
+
+#include "colorconvert.h"
+#include "colorvalidation.h"
+#include "colorlut.h"
+#include "gamutmapping.h"
+
+// Accuracy and performance tests for the color conversions:
+//    - the built-in color spaces against reference matrices, primaries and
+//      transfer functions
+//    - round trip error bounds for each precision
+//    - the 8-bit kernels against the exact conversion, and the SIMD kernels
+//      against the scalar ones
+//    - the worst case round trip error over all 8-bit colors
+//    - gamut mapping, analytical and baked into a 3D LUT
+//    - throughput floors for each kernel, so that a change which makes a
+//      kernel drift in speed fails as well. The floors are conservative and
+//      apply to release builds; set COLORCONVERT_THROUGHPUT_SCALE to scale
+//      them for slow machines (0 disables the check).
+
+Q_DECLARE_METATYPE(RgbColorSpace)
+Q_DECLARE_METATYPE(ColorTransform::Precision)
+Q_DECLARE_METATYPE(SimdLevel)
+Q_DECLARE_METATYPE(GamutMapping::Strategy)
+
+class tst_ColorConvert : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanup();
+
+    void matrices_data();
+    void matrices();
+    void primaries_data();
+    void primaries();
+    void chromaticAdaptation();
+    void transferFunctions_data();
+    void transferFunctions();
+    void convertRGBtoXYZ();
+
+    void roundTrip_data();
+    void roundTrip();
+    void accuracy_data();
+    void accuracy();
+    void deepColorAccuracy();
+    void conversionChain();
+    void otherImageFormats_data();
+    void otherImageFormats();
+    void roundTripSweep_data();
+    void roundTripSweep();
+    void gamutMappingInGamut();
+    void gamutMappingRamps_data();
+    void gamutMappingRamps();
+    void gamutMappingLut();
+    void lutPremultiplied();
+    void simdKernels_data();
+    void simdKernels();
+    void throughput_data();
+    void throughput();
+
+private:
+    SimdLevel m_simdLevel;
+};
+
+static const ColorTransform::Precision allPrecisions[] = {
+    ColorTransform::Lookup, ColorTransform::FixedPoint, ColorTransform::Approximate, ColorTransform::Exact
+};
+
+// Deterministic pseudo-random opaque pixels
+static QVector<QRgb> randomPixels(int count, quint32 seed)
+{
+    QVector<QRgb> pixels(count);
+    for (QRgb &pixel : pixels) {
+        seed = seed * 1664525 + 1013904223;
+        pixel = 0xff000000 | (seed >> 8);
+    }
+    return pixels;
+}
+
+// Whether the 8-bit color is inside the gamut of destination (exactly, by
+// the matrix), so that a round trip through it does not clip.
+static bool isInGamut(QRgb pixel, const RGBColorSpace &source, const RGBColorSpace &destination)
+{
+    const QGenericMatrix<3, 3, qreal> matrix = RGBColorSpace::createRGBtoRGBMatrix(source, destination);
+    const TransferFunction transferFunction = source.transferFunction();
+    const qreal linear[3] = { transferFunction.toLinear(qRed(pixel) / 255.0),
+                              transferFunction.toLinear(qGreen(pixel) / 255.0),
+                              transferFunction.toLinear(qBlue(pixel) / 255.0) };
+    for (int row = 0; row < 3; ++row) {
+        const qreal value = matrix(row, 0) * linear[0] + matrix(row, 1) * linear[1] + matrix(row, 2) * linear[2];
+        if (value < 0 || value > 1)
+            return false;
+    }
+    return true;
+}
+
+void tst_ColorConvert::initTestCase()
+{
+    m_simdLevel = simdLevel();
+    qInfo("SIMD level: %s", qPrintable(simdLevelName(m_simdLevel)));
+}
+
+void tst_ColorConvert::cleanup()
+{
+    setSimdLevel(m_simdLevel);
+}
+
+// RGB -> XYZ matrices from http://www.brucelindbloom.com (sRGB, Adobe RGB,
+// ProPhoto and Wide Gamut, D50 for the latter two), and as published for
+// Rec. 709, Rec. 2020 (ITU-R BT.2087) and P3 with the D65 white point
+// (SMPTE EG 432-1). The references are given to 4-7 decimals and differ in
+// how they round the white point, hence the tolerance.
+void tst_ColorConvert::matrices_data()
+{
+    QTest::addColumn<RgbColorSpace>("colorSpace");
+    QTest::addColumn<QVector<qreal>>("reference");
+
+    const QVector<qreal> sRGB_ = { 0.4124564, 0.3575761, 0.1804375,
+                            0.2126729, 0.7151522, 0.0721750,
+                            0.0193339, 0.1191920, 0.9503041 };
+    const QVector<qreal> adobeRGB = { 0.5767309, 0.1855540, 0.1881852,
+                               0.2973769, 0.6273491, 0.0752741,
+                               0.0270343, 0.0706872, 0.9911085 };
+    const QVector<qreal> proPhotoRGB = { 0.7976749, 0.1351917, 0.0313534,
+                                  0.2880402, 0.7118741, 0.0000857,
+                                  0.0000000, 0.0000000, 0.8252100 };
+    const QVector<qreal> wideGamutRGB = { 0.7161046, 0.1009296, 0.1471858,
+                                   0.2581874, 0.7249378, 0.0168748,
+                                   0.0000000, 0.0517813, 0.7734287 };
+    const QVector<qreal> rec709 = { 0.4124, 0.3576, 0.1805,
+                             0.2126, 0.7152, 0.0722,
+                             0.0193, 0.1192, 0.9505 };
+    const QVector<qreal> rec2020 = { 0.6369580, 0.1446169, 0.1688810,
+                              0.2627002, 0.6779981, 0.0593017,
+                              0.0000000, 0.0280727, 1.0609851 };
+    const QVector<qreal> p3D65 = { 0.4865709, 0.2656677, 0.1982173,
+                            0.2289746, 0.6917385, 0.0792869,
+                            0.0000000, 0.0451134, 1.0439444 };
+
+    QTest::newRow("sRGB") << sRGB << sRGB_;
+    QTest::newRow("AdobeRGB") << AdobeRGB << adobeRGB;
+    QTest::newRow("ProPhotoRGB") << ProPhotoRGB << proPhotoRGB;
+    QTest::newRow("AdobeWideGamutRGB") << AdobeWideGamutRGB << wideGamutRGB;
+    QTest::newRow("Rec709") << Rec709 << rec709;
+    QTest::newRow("Rec2020") << Rec2020 << rec2020;
+    QTest::newRow("DCI-P3") << DCI_P3 << p3D65;
+    QTest::newRow("DisplayP3") << DisplayP3 << p3D65;
+}
+
+void tst_ColorConvert::matrices()
+{
+    QFETCH(RgbColorSpace, colorSpace);
+    QFETCH(QVector<qreal>, reference);
+
+    const RGBColorSpace rgbColorSpace(colorSpace);
+    const QGenericMatrix<3, 3, qreal> RGBtoXYZ = rgbColorSpace.RGBtoXYZMatrix();
+    const QGenericMatrix<3, 3, qreal> identity = rgbColorSpace.XYZtoRGBMatrix() * RGBtoXYZ;
+    for (int row = 0; row < 3; ++row) {
+        for (int column = 0; column < 3; ++column) {
+            QVERIFY2(qAbs(RGBtoXYZ(row, column) - reference.at(row * 3 + column)) < 1e-3,
+                     qPrintable(QString("RGBtoXYZ(%1, %2) = %3, expected %4").arg(row).arg(column)
+                                .arg(RGBtoXYZ(row, column), 0, 'g', 8).arg(reference.at(row * 3 + column))));
+            QVERIFY(qAbs(identity(row, column) - (row == column ? 1 : 0)) < 1e-6);
+        }
+    }
+}
+
+// Primaries and white points as specified: the xy chromaticities of the
+// matrix columns and of RGB white.
+void tst_ColorConvert::primaries_data()
+{
+    QTest::addColumn<RgbColorSpace>("colorSpace");
+    QTest::addColumn<QVector<qreal>>("rgbw_xy");
+
+    const QVector<qreal> D65 = { 0.3127, 0.3290 };
+    const QVector<qreal> D50 = { 0.3457, 0.3585 };
+    QTest::newRow("sRGB") << sRGB << (QVector<qreal>{ 0.64, 0.33, 0.30, 0.60, 0.15, 0.06 } + D65);
+    QTest::newRow("AdobeRGB") << AdobeRGB << (QVector<qreal>{ 0.64, 0.33, 0.21, 0.71, 0.15, 0.06 } + D65);
+    QTest::newRow("ProPhotoRGB") << ProPhotoRGB << (QVector<qreal>{ 0.7347, 0.2653, 0.1596, 0.8404, 0.0366, 0.0001 } + D50);
+    QTest::newRow("AdobeWideGamutRGB") << AdobeWideGamutRGB
+                                       << (QVector<qreal>{ 0.7347, 0.2653, 0.1152, 0.8264, 0.1566, 0.0177 } + D50);
+    QTest::newRow("Rec709") << Rec709 << (QVector<qreal>{ 0.64, 0.33, 0.30, 0.60, 0.15, 0.06 } + D65);
+    QTest::newRow("Rec2020") << Rec2020 << (QVector<qreal>{ 0.708, 0.292, 0.170, 0.797, 0.131, 0.046 } + D65);
+    QTest::newRow("DCI-P3") << DCI_P3 << (QVector<qreal>{ 0.680, 0.320, 0.265, 0.690, 0.150, 0.060 } + D65);
+    QTest::newRow("DisplayP3") << DisplayP3 << (QVector<qreal>{ 0.680, 0.320, 0.265, 0.690, 0.150, 0.060 } + D65);
+}
+
+void tst_ColorConvert::primaries()
+{
+    QFETCH(RgbColorSpace, colorSpace);
+    QFETCH(QVector<qreal>, rgbw_xy);
+
+    const QGenericMatrix<3, 3, qreal> RGBtoXYZ = RGBColorSpace(colorSpace).RGBtoXYZMatrix();
+    for (int i = 0; i < 4; ++i) {
+        // Columns are the XYZ of red, green and blue; white is their sum
+        qreal XYZ[3];
+        for (int row = 0; row < 3; ++row)
+            XYZ[row] = (i < 3) ? RGBtoXYZ(row, i) : RGBtoXYZ(row, 0) + RGBtoXYZ(row, 1) + RGBtoXYZ(row, 2);
+        const qreal sum = XYZ[0] + XYZ[1] + XYZ[2];
+        QVERIFY2(qAbs(XYZ[0] / sum - rgbw_xy[i * 2]) < 5e-4 && qAbs(XYZ[1] / sum - rgbw_xy[i * 2 + 1]) < 5e-4,
+                 qPrintable(QString("%1: xy (%2, %3), expected (%4, %5)").arg("RGBW"[i])
+                            .arg(XYZ[0] / sum).arg(XYZ[1] / sum).arg(rgbw_xy[i * 2]).arg(rgbw_xy[i * 2 + 1])));
+    }
+
+    // White has luminance 1
+    QVERIFY(qAbs(RGBtoXYZ(1, 0) + RGBtoXYZ(1, 1) + RGBtoXYZ(1, 2) - 1) < 1e-6);
+}
+
+// Bradford D65 -> D50 as published by Lindbloom, and white mapping to white
+// between color spaces with different white points.
+void tst_ColorConvert::chromaticAdaptation()
+{
+    const qreal reference[9] = { 1.0478112, 0.0228866, -0.0501270,
+                                 0.0295424, 0.9904844, -0.0170491,
+                                -0.0092345, 0.0150436, 0.7521316 };
+    const QGenericMatrix<3, 3, qreal> bradford
+        = RGBColorSpace::chromaticAdaptationMatrix(QPointF(0.3127, 0.3290), QPointF(0.3457, 0.3585));
+    for (int i = 0; i < 9; ++i)
+        QVERIFY2(qAbs(bradford(i / 3, i % 3) - reference[i]) < 2e-3,
+                 qPrintable(QString("(%1, %2) = %3, expected %4").arg(i / 3).arg(i % 3)
+                            .arg(bradford(i / 3, i % 3)).arg(reference[i])));
+
+    QVERIFY(qAbs(RGBColorSpace(sRGB).whitePoint().x() - 0.3127) < 5e-4);
+    QVERIFY(qAbs(RGBColorSpace(ProPhotoRGB).whitePoint().y() - 0.3585) < 5e-4);
+
+    const RgbColorSpace colorSpaces[] = { sRGB, ProPhotoRGB, AdobeWideGamutRGB, Rec2020 };
+    for (RgbColorSpace source : colorSpaces) {
+        for (RgbColorSpace destination : colorSpaces) {
+            for (RGBColorSpace::ChromaticAdaptation method : { RGBColorSpace::Bradford, RGBColorSpace::CAT02 }) {
+                const QGenericMatrix<3, 3, qreal> matrix
+                    = RGBColorSpace::createRGBtoRGBMatrix(source, destination, method);
+                for (int row = 0; row < 3; ++row)
+                    QVERIFY(qAbs(matrix(row, 0) + matrix(row, 1) + matrix(row, 2) - 1) < 1e-6);
+            }
+        }
+    }
+    QCOMPARE(RGBColorSpace::colorConvert(QColor(Qt::white), sRGB, ProPhotoRGB), QColor(Qt::white));
+}
+
+// Encoded -> linear values from the transfer function definitions: IEC
+// 61966-2-1 (sRGB), ITU-R BT.709 and BT.2020, Adobe RGB (1998) (gamma
+// 563/256), ROMM RGB (ProPhoto) and SMPTE RP 431-2 (DCI-P3, gamma 2.6).
+void tst_ColorConvert::transferFunctions_data()
+{
+    QTest::addColumn<RgbColorSpace>("colorSpace");
+    QTest::addColumn<qreal>("encoded");
+    QTest::addColumn<qreal>("linear");
+
+    QTest::newRow("sRGB 0.5") << sRGB << 0.5 << 0.21404114;
+    QTest::newRow("sRGB 0.04045") << sRGB << 0.04045 << 0.0031308;
+    QTest::newRow("sRGB 0.02") << sRGB << 0.02 << 0.02 / 12.92;
+    QTest::newRow("DisplayP3 0.5") << DisplayP3 << 0.5 << 0.21404114;
+    QTest::newRow("Rec709 0.5") << Rec709 << 0.5 << 0.25958940;
+    QTest::newRow("Rec709 0.04") << Rec709 << 0.04 << 0.04 / 4.5;
+    QTest::newRow("Rec2020 0.5") << Rec2020 << 0.5 << 0.25971944;
+    QTest::newRow("AdobeRGB 0.5") << AdobeRGB << 0.5 << 0.21775553;
+    QTest::newRow("ProPhotoRGB 0.5") << ProPhotoRGB << 0.5 << 0.28717459;
+    QTest::newRow("ProPhotoRGB 0.03125") << ProPhotoRGB << 0.03125 << 0.001953125;
+    QTest::newRow("DCI-P3 0.5") << DCI_P3 << 0.5 << 0.16493849;
+}
+
+void tst_ColorConvert::transferFunctions()
+{
+    QFETCH(RgbColorSpace, colorSpace);
+    QFETCH(qreal, encoded);
+    QFETCH(qreal, linear);
+
+    const TransferFunction transferFunction = colorSpaceTransferFunction(colorSpace);
+    QVERIFY(qAbs(transferFunction.toLinear(encoded) - linear) < 1e-7);
+    QVERIFY(qAbs(transferFunction.toNonlinear(linear) - encoded) < 1e-6);
+    QVERIFY(qAbs(transferFunction.toNonlinear(transferFunction.toLinear(encoded)) - encoded) < 1e-12);
+
+    // The approximations are within 3e-6 relative error
+    QVERIFY(qAbs(transferFunction.toLinearApproximate(encoded) - linear) <= 3e-6 * linear + 1e-9);
+    QVERIFY(qAbs(transferFunction.toNonlinearApproximate(linear) - encoded) <= 3e-6 * encoded + 1e-9);
+}
+
+// sRGB { 1.0, 0.5, 0.0 } to XYZ and back. Reference XYZ from
+// http://davengrace.com/cgi-bin/cspace.pl
+void tst_ColorConvert::convertRGBtoXYZ()
+{
+    const RGBColorSpace sRGBSpace(sRGB);
+    const float rgb[] = { 1.0f, 0.5f, 0.0f };
+    float XYZ[3];
+    sRGBSpace.convertRGBtoXYZ(rgb, XYZ, 1);
+    QVERIFY(qAbs(XYZ[0] - 0.488941111836446) < 1e-4);
+    QVERIFY(qAbs(XYZ[1] - 0.365682223672893) < 1e-4);
+    QVERIFY(qAbs(XYZ[2] - 0.0448137039454821) < 1e-4);
+
+    float Yxy[3];
+    float rgb2[3];
+    sRGBSpace.convertRGBtoYxy(rgb, Yxy, 1);
+    sRGBSpace.convertYxyToRGB(Yxy, rgb2, 1);
+    for (int i = 0; i < 3; ++i)
+        QVERIFY(qAbs(rgb2[i] - rgb[i]) < 1e-5);
+}
+
+// Round trips between all pairs of built-in color spaces, for colors in
+// both gamuts. Errors are measured in linear light: near black the pure
+// power curves are steep enough to turn any rounding into large encoded
+// differences.
+void tst_ColorConvert::roundTrip_data()
+{
+    QTest::addColumn<ColorTransform::Precision>("precision");
+    QTest::addColumn<qreal>("floatTolerance");
+
+    // Lookup and FixedPoint apply to QRgb data only; float data uses the
+    // approximations.
+    QTest::newRow("lookup") << ColorTransform::Lookup << 5e-6;
+    QTest::newRow("fixed") << ColorTransform::FixedPoint << 5e-6;
+    QTest::newRow("approximate") << ColorTransform::Approximate << 5e-6;
+    QTest::newRow("exact") << ColorTransform::Exact << 1e-6;
+}
+
+void tst_ColorConvert::roundTrip()
+{
+    QFETCH(ColorTransform::Precision, precision);
+    QFETCH(qreal, floatTolerance);
+
+    // 8-bit: one quantization step in each color space
+    const qreal tolerance8Bit = 0.015;
+
+    const QVector<QRgb> pixels = randomPixels(1 << 14, 1);
+    for (int source = 0; source < ColorSpaceCount; ++source) {
+        for (int destination = 0; destination < ColorSpaceCount; ++destination) {
+            const RGBColorSpace sourceColorSpace = RGBColorSpace(RgbColorSpace(source));
+            const RGBColorSpace destinationColorSpace = RGBColorSpace(RgbColorSpace(destination));
+            const ColorTransform there(sourceColorSpace, destinationColorSpace, ColorTransform::NoFlags, precision);
+            const ColorTransform back(destinationColorSpace, sourceColorSpace, ColorTransform::NoFlags, precision);
+            const TransferFunction transferFunction = sourceColorSpace.transferFunction();
+
+            QVector<QRgb> input;
+            QVector<float> floatInput;
+            for (QRgb pixel : pixels) {
+                if (!isInGamut(pixel, sourceColorSpace, destinationColorSpace))
+                    continue;
+                input.append(pixel);
+                floatInput << qRed(pixel) / 255.0f << qGreen(pixel) / 255.0f << qBlue(pixel) / 255.0f;
+            }
+
+            QVector<QRgb> output(input.count());
+            there.apply(input.constData(), output.data(), input.count());
+            back.apply(output.constData(), output.data(), input.count());
+
+            QVector<float> floatOutput(floatInput.count());
+            there.apply(floatInput.constData(), floatOutput.data(), input.count());
+            back.apply(floatOutput.constData(), floatOutput.data(), input.count());
+
+            qreal maxError8Bit = 0;
+            qreal maxErrorFloat = 0;
+            for (int i = 0; i < input.count(); ++i) {
+                for (int shift : { 16, 8, 0 }) {
+                    const qreal expected = transferFunction.toLinear(((input.at(i) >> shift) & 0xff) / 255.0);
+                    const qreal actual = transferFunction.toLinear(((output.at(i) >> shift) & 0xff) / 255.0);
+                    maxError8Bit = qMax(maxError8Bit, qAbs(actual - expected));
+                }
+                for (int c = 0; c < 3; ++c) {
+                    const qreal expected = transferFunction.toLinear(floatInput.at(i * 3 + c));
+                    const qreal actual = transferFunction.toLinear(floatOutput.at(i * 3 + c));
+                    maxErrorFloat = qMax(maxErrorFloat, qAbs(actual - expected));
+                }
+            }
+
+            const QString pair = colorSpaceName(RgbColorSpace(source)) + " <-> " + colorSpaceName(RgbColorSpace(destination));
+            QVERIFY2(maxError8Bit <= tolerance8Bit,
+                     qPrintable(QString("%1: 8-bit error %2").arg(pair).arg(maxError8Bit)));
+            QVERIFY2(maxErrorFloat <= floatTolerance,
+                     qPrintable(QString("%1: float error %2").arg(pair).arg(maxErrorFloat)));
+        }
+    }
+}
+
+// 8-bit output of each precision against the exact conversion. The fixed
+// point pipeline quantizes linear light to 15 bits, which shows in the
+// darkest output values only.
+void tst_ColorConvert::accuracy_data()
+{
+    QTest::addColumn<ColorTransform::Precision>("precision");
+    QTest::addColumn<int>("maxError");
+    QTest::addColumn<int>("maxErrorAbove16");
+    QTest::addColumn<qreal>("maxMeanError");
+
+    QTest::newRow("lookup") << ColorTransform::Lookup << 1 << 1 << 0.01;
+    QTest::newRow("fixed") << ColorTransform::FixedPoint << 10 << 2 << 0.05;
+    QTest::newRow("approximate") << ColorTransform::Approximate << 1 << 1 << 0.01;
+}
+
+void tst_ColorConvert::accuracy()
+{
+    QFETCH(ColorTransform::Precision, precision);
+    QFETCH(int, maxError);
+    QFETCH(int, maxErrorAbove16);
+    QFETCH(qreal, maxMeanError);
+
+    const QVector<QRgb> pixels = randomPixels(1 << 16, 2);
+    QVector<QRgb> output(pixels.count());
+    QVector<QRgb> reference(pixels.count());
+    for (int source = 0; source < ColorSpaceCount; ++source) {
+        for (int destination = 0; destination < ColorSpaceCount; ++destination) {
+            const RGBColorSpace sourceColorSpace = RGBColorSpace(RgbColorSpace(source));
+            const RGBColorSpace destinationColorSpace = RGBColorSpace(RgbColorSpace(destination));
+            ColorTransform(sourceColorSpace, destinationColorSpace, ColorTransform::NoFlags, precision)
+                .apply(pixels.constData(), output.data(), pixels.count());
+            ColorTransform(sourceColorSpace, destinationColorSpace, ColorTransform::NoFlags, ColorTransform::Exact)
+                .apply(pixels.constData(), reference.data(), pixels.count());
+
+            int worst = 0;
+            int worstAbove16 = 0;
+            qint64 sum = 0;
+            for (int i = 0; i < pixels.count(); ++i) {
+                for (int shift : { 16, 8, 0 }) {
+                    const int expected = (reference.at(i) >> shift) & 0xff;
+                    const int error = qAbs(int((output.at(i) >> shift) & 0xff) - expected);
+                    worst = qMax(worst, error);
+                    if (expected >= 16)
+                        worstAbove16 = qMax(worstAbove16, error);
+                    sum += error;
+                }
+            }
+            const qreal mean = qreal(sum) / (pixels.count() * 3);
+
+            const QString pair = colorSpaceName(RgbColorSpace(source)) + " -> " + colorSpaceName(RgbColorSpace(destination));
+            QVERIFY2(worst <= maxError && worstAbove16 <= maxErrorAbove16 && mean <= maxMeanError,
+                     qPrintable(QString("%1: max error %2 (%3 above 16), mean %4")
+                                .arg(pair).arg(worst).arg(worstAbove16).arg(mean)));
+        }
+    }
+}
+
+// 16-bit images keep their precision with every precision: Lookup does
+// not go through the 8-bit tables.
+void tst_ColorConvert::deepColorAccuracy()
+{
+    const QVector<QRgb> pixels = randomPixels(1 << 14, 8);
+    QImage source(128, pixels.count() / 128, QImage::Format_RGBX64);
+    for (int y = 0; y < source.height(); ++y) {
+        QRgba64 *line = reinterpret_cast<QRgba64 *>(source.scanLine(y));
+        for (int x = 0; x < source.width(); ++x) {
+            // 16-bit values which are not 8-bit values
+            const QRgb pixel = pixels.at(y * source.width() + x);
+            line[x] = QRgba64::fromRgba64(quint16(pixel * 2654435761u), quint16(pixel >> 4),
+                                          quint16(pixel ^ (pixel << 7)), 0xffff);
+        }
+    }
+
+    for (ColorTransform::Precision precision : allPrecisions) {
+        QImage output = source;
+        QImage reference = source;
+        ColorTransform(RGBColorSpace(sRGB), RGBColorSpace(AdobeRGB), ColorTransform::NoFlags, precision)
+            .apply(&output);
+        ColorTransform(RGBColorSpace(sRGB), RGBColorSpace(AdobeRGB), ColorTransform::NoFlags, ColorTransform::Exact)
+            .apply(&reference);
+
+        int worst = 0;
+        for (int y = 0; y < source.height(); ++y) {
+            const QRgba64 *actual = reinterpret_cast<const QRgba64 *>(output.constScanLine(y));
+            const QRgba64 *expected = reinterpret_cast<const QRgba64 *>(reference.constScanLine(y));
+            for (int x = 0; x < source.width(); ++x) {
+                worst = qMax(worst, qAbs(int(actual[x].red()) - int(expected[x].red())));
+                worst = qMax(worst, qAbs(int(actual[x].green()) - int(expected[x].green())));
+                worst = qMax(worst, qAbs(int(actual[x].blue()) - int(expected[x].blue())));
+            }
+        }
+        // A few 16-bit levels; interpolating the 8-bit tables was off by many more.
+        QVERIFY2(worst <= 4, qPrintable(QString("%1: max error %2 16-bit levels")
+                                        .arg(ColorTransform::precisionName(precision)).arg(worst)));
+    }
+}
+
+// A chain converts float data with the approximations unless its precision
+// is Exact, as ColorTransform does, and matches the transforms for its hops.
+void tst_ColorConvert::conversionChain()
+{
+    const QVector<RGBColorSpace> colorSpaces = { RGBColorSpace(sRGB), RGBColorSpace(AdobeRGB),
+                                                 RGBColorSpace(DisplayP3) };
+    const ColorConversionChain chain(colorSpaces);
+    const ColorConversionChain exactChain(colorSpaces, ColorTransform::Exact);
+    QCOMPARE(chain.precision(), ColorTransform::Lookup);
+
+    const QVector<QRgb> pixels = randomPixels(1 << 12, 10);
+    QVector<float> rgb;
+    for (QRgb pixel : pixels)
+        rgb << qRed(pixel) / 255.0f << qGreen(pixel) / 255.0f << qBlue(pixel) / 255.0f;
+
+    QVector<float> output(rgb.count());
+    QVector<float> exact(rgb.count());
+    QVector<float> stepwise(rgb.count());
+    chain.convert(rgb.constData(), output.data(), pixels.count());
+    exactChain.convert(rgb.constData(), exact.data(), pixels.count());
+    ColorTransform(colorSpaces.at(0), colorSpaces.at(1), ColorTransform::NoFlags, ColorTransform::Exact)
+        .apply(rgb.constData(), stepwise.data(), pixels.count());
+    ColorTransform(colorSpaces.at(1), colorSpaces.at(2), ColorTransform::NoFlags, ColorTransform::Exact)
+        .apply(stepwise.constData(), stepwise.data(), pixels.count());
+
+    qreal maxError = 0;
+    qreal maxStepwiseError = 0;
+    for (int i = 0; i < rgb.count(); ++i) {
+        maxError = qMax(maxError, qreal(qAbs(output.at(i) - exact.at(i))));
+        maxStepwiseError = qMax(maxStepwiseError, qreal(qAbs(exact.at(i) - stepwise.at(i))));
+    }
+    QVERIFY2(maxError < 1e-4, qPrintable(QString("max error %1").arg(maxError)));
+    QVERIFY2(maxStepwiseError < 1e-5, qPrintable(QString("max stepwise error %1").arg(maxStepwiseError)));
+}
+
+// Images in formats without kernels (here RGB888) are converted through
+// RGB32 and keep their format, with the same result as an RGB32 image.
+void tst_ColorConvert::otherImageFormats_data()
+{
+    QTest::addColumn<ColorTransform::Precision>("precision");
+    for (ColorTransform::Precision precision : allPrecisions)
+        QTest::newRow(qPrintable(ColorTransform::precisionName(precision))) << precision;
+}
+
+void tst_ColorConvert::otherImageFormats()
+{
+    QFETCH(ColorTransform::Precision, precision);
+
+    const QVector<QRgb> pixels = randomPixels(1 << 12, 9);
+    QImage rgb32(61, pixels.count() / 61, QImage::Format_RGB32); // odd width: unaligned RGB888 lines
+    for (int y = 0; y < rgb32.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(rgb32.scanLine(y));
+        for (int x = 0; x < rgb32.width(); ++x)
+            line[x] = pixels.at(y * rgb32.width() + x);
+    }
+    QImage rgb888 = rgb32.convertToFormat(QImage::Format_RGB888);
+    QCOMPARE(convertibleImageFormat(rgb888), QImage::Format_RGB32);
+
+    const ColorTransform transform(RGBColorSpace(sRGB), RGBColorSpace(AdobeRGB), ColorTransform::NoFlags, precision);
+    QImage expected = rgb32;
+    transform.apply(&expected);
+    QImage actual = rgb888;
+    transform.apply(&actual);
+    QCOMPARE(actual.format(), QImage::Format_RGB888);
+    QCOMPARE(actual.convertToFormat(QImage::Format_RGB32), expected);
+
+    const ColorConversionChain chain({ RGBColorSpace(sRGB), RGBColorSpace(AdobeRGB) });
+    actual = rgb888;
+    chain.convert(&actual);
+    QCOMPARE(actual.format(), QImage::Format_RGB888);
+
+    const ColorLut3D lut = ColorLut3D::fromTransform(transform);
+    expected = rgb32;
+    lut.apply(&expected);
+    actual = rgb888;
+    lut.apply(&actual);
+    QCOMPARE(actual.format(), QImage::Format_RGB888);
+    QCOMPARE(actual.convertToFormat(QImage::Format_RGB32), expected);
+}
+
+// Round trips of all 8-bit colors. The errors are dominated by 8-bit
+// quantization in the destination color space, for dark saturated colors;
+// Exact round trips are no better than Lookup.
+void tst_ColorConvert::roundTripSweep_data()
+{
+    QTest::addColumn<RgbColorSpace>("source");
+    QTest::addColumn<RgbColorSpace>("destination");
+    QTest::addColumn<ColorTransform::Precision>("precision");
+    QTest::addColumn<int>("maxError");
+    QTest::addColumn<qreal>("maxMeanError");
+    QTest::addColumn<bool>("clips");
+
+    QTest::newRow("lookup sRGB -> AdobeRGB") << sRGB << AdobeRGB << ColorTransform::Lookup << 13 << 0.25 << false;
+    QTest::newRow("fixed sRGB -> AdobeRGB") << sRGB << AdobeRGB << ColorTransform::FixedPoint << 13 << 0.25 << false;
+    QTest::newRow("fixed AdobeRGB -> sRGB") << AdobeRGB << sRGB << ColorTransform::FixedPoint << 5 << 0.04 << true;
+    QTest::newRow("fixed sRGB -> Rec709") << sRGB << Rec709 << ColorTransform::FixedPoint << 1 << 0.07 << false;
+}
+
+void tst_ColorConvert::roundTripSweep()
+{
+    QFETCH(RgbColorSpace, source);
+    QFETCH(RgbColorSpace, destination);
+    QFETCH(ColorTransform::Precision, precision);
+    QFETCH(int, maxError);
+    QFETCH(qreal, maxMeanError);
+    QFETCH(bool, clips);
+
+    const RGBColorSpace sourceColorSpace(source);
+    const RGBColorSpace destinationColorSpace(destination);
+    const RoundTripStatistics statistics = measureRoundTrip(sourceColorSpace, destinationColorSpace, precision);
+    QVERIFY2(statistics.maxError <= maxError && statistics.meanError <= maxMeanError,
+             qPrintable(QString("max error %1, mean %2").arg(statistics.maxError).arg(statistics.meanError)));
+    QCOMPARE(statistics.colorCount + statistics.clippedCount, qint64(1) << 24);
+    QCOMPARE(statistics.clippedCount > 0, clips);
+
+    // The worst case is reproducible
+    QRgb output = statistics.worstInput;
+    ColorTransform(sourceColorSpace, destinationColorSpace, ColorTransform::NoFlags, precision).apply(&output, &output, 1);
+    ColorTransform(destinationColorSpace, sourceColorSpace, ColorTransform::NoFlags, precision).apply(&output, &output, 1);
+    QCOMPARE(output, statistics.worstOutput);
+    QCOMPARE(qMax(qAbs(qRed(output) - qRed(statistics.worstInput)),
+                  qMax(qAbs(qGreen(output) - qGreen(statistics.worstInput)),
+                       qAbs(qBlue(output) - qBlue(statistics.worstInput)))), statistics.maxError);
+
+    // and independent of the thread count
+    const RoundTripStatistics singleThreaded = measureRoundTrip(sourceColorSpace, destinationColorSpace, precision, 1);
+    QCOMPARE(singleThreaded.maxError, statistics.maxError);
+    QCOMPARE(singleThreaded.worstInput, statistics.worstInput);
+    QCOMPARE(singleThreaded.meanError, statistics.meanError);
+    QCOMPARE(singleThreaded.clippedCount, statistics.clippedCount);
+}
+
+// Colors well inside the destination gamut are left as they are by the soft
+// knee, and by all strategies if the source gamut fits in the destination.
+void tst_ColorConvert::gamutMappingInGamut()
+{
+    const float colors[] = { 0.5f, 0.5f, 0.5f,  0.6f, 0.5f, 0.4f,  0.2f, 0.3f, 0.35f,  1.0f, 1.0f, 1.0f,
+                             0.0f, 0.0f, 0.0f,  0.45f, 0.55f, 0.5f };
+    const int count = sizeof(colors) / sizeof(float) / 3;
+    float expected[count * 3];
+    float mapped[count * 3];
+
+    const RGBColorSpace rec2020(Rec2020);
+    const RGBColorSpace sRGBSpace(sRGB);
+    ColorTransform(rec2020, sRGBSpace, ColorTransform::NoFlags, ColorTransform::Exact).apply(colors, expected, count);
+    GamutMapping(rec2020, sRGBSpace, GamutMapping::SoftKnee).apply(colors, mapped, count);
+    for (int i = 0; i < count * 3; ++i)
+        QVERIFY2(qAbs(mapped[i] - expected[i]) < 1e-4, qPrintable(QString("color %1").arg(i / 3)));
+
+    const QVector<QRgb> pixels = randomPixels(4096, 5);
+    QVector<float> rgb;
+    for (QRgb pixel : pixels)
+        rgb << qRed(pixel) / 255.0f << qGreen(pixel) / 255.0f << qBlue(pixel) / 255.0f;
+    QVector<float> reference(rgb.count());
+    QVector<float> output(rgb.count());
+    const RGBColorSpace adobeRGB(AdobeRGB);
+    ColorTransform(sRGBSpace, adobeRGB, ColorTransform::NoFlags, ColorTransform::Exact)
+        .apply(rgb.constData(), reference.data(), pixels.count());
+    for (GamutMapping::Strategy strategy : { GamutMapping::Clip, GamutMapping::ChromaCompression, GamutMapping::SoftKnee }) {
+        GamutMapping(sRGBSpace, adobeRGB, strategy).apply(rgb.constData(), output.data(), pixels.count());
+        for (int i = 0; i < rgb.count(); ++i)
+            QVERIFY2(qAbs(output.at(i) - reference.at(i)) < 1e-4, qPrintable(GamutMapping::strategyName(strategy)));
+    }
+}
+
+// Ramps from gray to the Rec. 2020 primaries and secondaries, mapped to
+// sRGB. Clipping collapses the out-of-gamut end of the ramps into long runs
+// of a single 8-bit color; the compressing strategies keep them graded.
+void tst_ColorConvert::gamutMappingRamps_data()
+{
+    QTest::addColumn<GamutMapping::Strategy>("strategy");
+    QTest::addColumn<int>("minLongestRun");
+    QTest::addColumn<int>("maxLongestRun");
+
+    QTest::newRow("clip") << GamutMapping::Clip << 64 << 1025;
+    QTest::newRow("chroma compression") << GamutMapping::ChromaCompression << 1 << 32;
+    QTest::newRow("soft knee") << GamutMapping::SoftKnee << 1 << 32;
+}
+
+void tst_ColorConvert::gamutMappingRamps()
+{
+    QFETCH(GamutMapping::Strategy, strategy);
+    QFETCH(int, minLongestRun);
+    QFETCH(int, maxLongestRun);
+
+    const GamutMapping mapping(RGBColorSpace(Rec2020), RGBColorSpace(sRGB), strategy);
+    const int steps = 1024;
+    int longestRun = 1;
+    for (QRgb end : { 0xff0000, 0x00ff00, 0x0000ff, 0xffff00, 0x00ffff, 0xff00ff }) {
+        QVector<float> ramp;
+        for (int i = 0; i <= steps; ++i) {
+            const float t = float(i) / steps;
+            ramp << 0.5f + (qRed(end) / 255.0f - 0.5f) * t << 0.5f + (qGreen(end) / 255.0f - 0.5f) * t
+                 << 0.5f + (qBlue(end) / 255.0f - 0.5f) * t;
+        }
+        mapping.apply(ramp.constData(), ramp.data(), steps + 1);
+
+        int run = 1;
+        for (int i = 1; i <= steps; ++i) {
+            bool same = true;
+            for (int c = 0; c < 3; ++c)
+                same &= qRound(ramp.at(i * 3 + c) * 255) == qRound(ramp.at((i - 1) * 3 + c) * 255);
+            run = same ? run + 1 : 1;
+            longestRun = qMax(longestRun, run);
+        }
+    }
+    QVERIFY2(longestRun >= minLongestRun && longestRun <= maxLongestRun,
+             qPrintable(QString("longest run %1").arg(longestRun)));
+}
+
+// The baked table follows the analytical mapping to within a fraction of an
+// 8-bit level on average. The mapping curves sharply near the gamut cusps,
+// where the table interpolates between grid points.
+void tst_ColorConvert::gamutMappingLut()
+{
+    const GamutMapping mapping(RGBColorSpace(Rec2020), RGBColorSpace(sRGB), GamutMapping::SoftKnee);
+    const ColorLut3D lut = ColorLut3D::fromGamutMapping(mapping);
+    QCOMPARE(lut.size(), int(ColorLut3D::DefaultSize));
+
+    const QVector<QRgb> pixels = randomPixels(1 << 14, 6);
+    QVector<float> rgb;
+    for (QRgb pixel : pixels)
+        rgb << qRed(pixel) / 255.0f << qGreen(pixel) / 255.0f << qBlue(pixel) / 255.0f;
+    QVector<float> expected(rgb.count());
+    mapping.apply(rgb.constData(), expected.data(), pixels.count());
+    QVector<QRgb> output(pixels.count());
+    lut.apply(pixels.constData(), output.data(), pixels.count());
+
+    qreal sum = 0;
+    for (int i = 0; i < pixels.count(); ++i) {
+        sum += qAbs(qRed(output.at(i)) - expected.at(i * 3 + 0) * 255)
+             + qAbs(qGreen(output.at(i)) - expected.at(i * 3 + 1) * 255)
+             + qAbs(qBlue(output.at(i)) - expected.at(i * 3 + 2) * 255);
+    }
+    const qreal mean = sum / (pixels.count() * 3);
+    QVERIFY2(mean < 0.5, qPrintable(QString("mean error %1").arg(mean)));
+}
+
+// Applying a table to a half-transparent premultiplied image gives the
+// straight alpha result, up to the rounding of premultiplication, and keeps
+// the pixels valid (no channel above alpha).
+void tst_ColorConvert::lutPremultiplied()
+{
+    const GamutMapping mapping(RGBColorSpace(Rec2020), RGBColorSpace(sRGB), GamutMapping::SoftKnee);
+    const ColorLut3D lut = ColorLut3D::fromGamutMapping(mapping);
+
+    const QVector<QRgb> pixels = randomPixels(1 << 14, 7);
+    QImage straight(128, pixels.count() / 128, QImage::Format_ARGB32);
+    for (int y = 0; y < straight.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(straight.scanLine(y));
+        for (int x = 0; x < straight.width(); ++x)
+            line[x] = (pixels.at(y * straight.width() + x) & 0x00ffffff) | 0x80000000;
+    }
+    QImage premultiplied = straight.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    lut.apply(&straight);
+    lut.apply(&premultiplied);
+    QCOMPARE(premultiplied.format(), QImage::Format_ARGB32_Premultiplied);
+
+    int maxError = 0;
+    for (int y = 0; y < straight.height(); ++y) {
+        const QRgb *expected = reinterpret_cast<const QRgb *>(straight.constScanLine(y));
+        const QRgb *actual = reinterpret_cast<const QRgb *>(premultiplied.constScanLine(y));
+        for (int x = 0; x < straight.width(); ++x) {
+            const QRgb pixel = actual[x];
+            QCOMPARE(qAlpha(pixel), 128);
+            QVERIFY(qRed(pixel) <= 128 && qGreen(pixel) <= 128 && qBlue(pixel) <= 128);
+            const QRgb unpremultiplied = qUnpremultiply(pixel);
+            maxError = qMax(maxError, qAbs(qRed(unpremultiplied) - qRed(expected[x])));
+            maxError = qMax(maxError, qAbs(qGreen(unpremultiplied) - qGreen(expected[x])));
+            maxError = qMax(maxError, qAbs(qBlue(unpremultiplied) - qBlue(expected[x])));
+        }
+    }
+    QVERIFY2(maxError <= 4, qPrintable(QString("max error %1").arg(maxError)));
+}
+
+// Each SIMD level available on this machine produces exactly the output of
+// the scalar kernels, for straight and premultiplied alpha.
+void tst_ColorConvert::simdKernels_data()
+{
+    QTest::addColumn<SimdLevel>("level");
+    QTest::addColumn<ColorTransform::Precision>("precision");
+    QTest::addColumn<QImage::Format>("format");
+
+    for (int level = SimdSse41; level <= supportedSimdLevel(); ++level) {
+        for (ColorTransform::Precision precision : { ColorTransform::Lookup, ColorTransform::FixedPoint }) {
+            for (QImage::Format format : { QImage::Format_ARGB32, QImage::Format_ARGB32_Premultiplied }) {
+                const QString tag = QString("%1 %2 %3").arg(simdLevelName(SimdLevel(level)))
+                                    .arg(ColorTransform::precisionName(precision))
+                                    .arg(format == QImage::Format_ARGB32 ? "straight" : "premultiplied");
+                QTest::newRow(qPrintable(tag)) << SimdLevel(level) << precision << format;
+            }
+        }
+    }
+}
+
+void tst_ColorConvert::simdKernels()
+{
+    QFETCH(SimdLevel, level);
+    QFETCH(ColorTransform::Precision, precision);
+    QFETCH(QImage::Format, format);
+
+    // Random colors with runs of opaque, transparent and mixed alpha, which
+    // take different paths in the premultiplied kernels. Odd width: the
+    // kernels finish each line with the scalar tail.
+    QImage image(1001, 64, QImage::Format_ARGB32);
+    quint32 seed = 3;
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            seed = seed * 1664525 + 1013904223;
+            const int run = (x / 32) % 3;
+            const int alpha = (run == 0) ? 255 : (run == 1) ? 0 : int(seed >> 24);
+            line[x] = (seed & 0xffffff) | (quint32(alpha) << 24);
+        }
+    }
+    image = image.convertToFormat(format);
+
+    for (int source = 0; source < ColorSpaceCount; ++source) {
+        for (int destination = 0; destination < ColorSpaceCount; ++destination) {
+            const ColorTransform transform(RGBColorSpace(RgbColorSpace(source)), RGBColorSpace(RgbColorSpace(destination)),
+                                           ColorTransform::PreserveAlpha, precision);
+            QImage reference = image.copy();
+            setSimdLevel(SimdScalar);
+            transform.apply(&reference, 1);
+
+            QImage output = image.copy();
+            setSimdLevel(level);
+            QCOMPARE(simdLevel(), level);
+            transform.apply(&output, 1);
+
+            QVERIFY2(output == reference,
+                     qPrintable(colorSpaceName(RgbColorSpace(source)) + " -> " + colorSpaceName(RgbColorSpace(destination))));
+        }
+    }
+}
+
+// Single threaded throughput floors in megapixels per second, for sRGB to
+// Adobe RGB. About a quarter of what a 2020s desktop CPU does. Approximate
+// and Exact convert at float precision without the SIMD kernels, so they
+// are timed at the scalar level only.
+void tst_ColorConvert::throughput_data()
+{
+    QTest::addColumn<SimdLevel>("level");
+    QTest::addColumn<ColorTransform::Precision>("precision");
+    QTest::addColumn<qreal>("floor");
+
+    const qreal floors[][3] = {
+        // scalar, sse4.1, avx2
+        { 15, 25, 50 }, // Lookup
+        { 1.5, 0, 0 }, // Approximate
+        { 1, 0, 0 }, // Exact
+        { 25, 50, 50 } // FixedPoint
+    };
+    for (int level = SimdScalar; level <= supportedSimdLevel(); ++level) {
+        for (ColorTransform::Precision precision : allPrecisions) {
+            if (level != SimdScalar
+                && (precision == ColorTransform::Approximate || precision == ColorTransform::Exact))
+                continue;
+            const QString tag = QString("%1 %2").arg(simdLevelName(SimdLevel(level))).arg(ColorTransform::precisionName(precision));
+            QTest::newRow(qPrintable(tag)) << SimdLevel(level) << precision << floors[precision][level];
+        }
+    }
+}
+
+void tst_ColorConvert::throughput()
+{
+#ifndef QT_NO_DEBUG
+    QSKIP("Throughput floors apply to release builds");
+#endif
+    QFETCH(SimdLevel, level);
+    QFETCH(ColorTransform::Precision, precision);
+    QFETCH(qreal, floor);
+
+    bool ok = false;
+    const qreal scale = qEnvironmentVariable("COLORCONVERT_THROUGHPUT_SCALE").toDouble(&ok);
+    if (ok)
+        floor *= scale;
+    if (floor <= 0)
+        QSKIP("Disabled by COLORCONVERT_THROUGHPUT_SCALE");
+
+    setSimdLevel(level);
+    const ColorTransform transform(RGBColorSpace(sRGB), RGBColorSpace(AdobeRGB), ColorTransform::NoFlags, precision);
+    const QVector<QRgb> pixels = randomPixels(1 << 20, 4);
+    QVector<QRgb> output(pixels.count());
+
+    // Best of several runs: the floor is about the kernel, not the load on
+    // the machine.
+    qint64 best = std::numeric_limits<qint64>::max();
+    for (int run = 0; run < 5; ++run) {
+        QElapsedTimer timer;
+        timer.start();
+        transform.apply(pixels.constData(), output.data(), pixels.count());
+        best = qMin(best, qMax(timer.nsecsElapsed(), qint64(1)));
+    }
+    const qreal megapixelsPerSecond = pixels.count() * 1000.0 / best;
+    qInfo("%s %s: %.1f MP/s", qPrintable(simdLevelName(level)), qPrintable(ColorTransform::precisionName(precision)), megapixelsPerSecond);
+    QVERIFY2(megapixelsPerSecond >= floor,
+             qPrintable(QString("%1 MP/s, floor %2 MP/s").arg(megapixelsPerSecond).arg(floor)));
+}
+
+QTEST_GUILESS_MAIN(tst_ColorConvert)
+
+#include "tst_colorconvert.moc"
@@ -0,0 +1,13 @@
+TEMPLATE = app
+
+TARGET = colorconvert-cli
+include(../../src/colorconvert.pri)
+
+SOURCES += main.cpp
+
+# No widgets or display: QtGui is used for QImage and the image plugins only
+QT = core gui
+CONFIG += console
+CONFIG -= app_bundle
+OBJECTS_DIR = .obj
+MOC_DIR = .moc
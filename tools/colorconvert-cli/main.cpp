@@ -0,0 +1,466 @@
+#include <QtCore>
+#include <QtGui>
+
+#include "colorconvert.h"
+#include "colorlut.h"
+#include "colorvalidation.h"
+#include "gamutmapping.h"
+
+#include <cstdio>
+
+// colorconvert-cli converts image files between RGB color spaces, without
+// a display:
+//
+//     colorconvert-cli --from sRGB --to AdobeRGB input/ output/
+//
+// Decoding, conversion and encoding run as a pipeline. Decoder and encoder
+// threads work on separate images while the current image is converted in
+// parallel bands. The queues between the stages are bounded, which limits
+// the number of images held in memory to about
+// decoders + encoders + 2 * queue depth + 1.
+//
+// Out-of-gamut colors are clipped by default. --gamut-mapping compress or
+// soft-knee maps them into the destination gamut instead, through a 3D LUT
+// baked once at startup.
+//
+// With --validate, no images are converted. Instead all 8-bit RGB colors are
+// round tripped through each pair of color spaces (or the --from and --to
+// pair), and the errors are printed as a table:
+//
+//     colorconvert-cli --validate --precision fixed --max-error 2
+
+// Queue between two pipeline stages. push() blocks while the queue is full,
+// and pop() while it is empty; pop() returns false once the queue has been
+// closed and drained.
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(int capacity)
+    :m_capacity(capacity)
+    ,m_closed(false)
+    {
+
+    }
+
+    void push(T item)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.count() >= m_capacity)
+            m_notFull.wait(&m_mutex);
+        m_items.enqueue(std::move(item));
+        m_notEmpty.wakeOne();
+    }
+
+    bool pop(T *item)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (m_items.isEmpty() && !m_closed)
+            m_notEmpty.wait(&m_mutex);
+        if (m_items.isEmpty())
+            return false;
+        *item = m_items.dequeue();
+        m_notFull.wakeOne();
+        return true;
+    }
+
+    void close()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    QQueue<T> m_items;
+    int m_capacity;
+    bool m_closed;
+};
+
+class FunctionTask : public QRunnable
+{
+public:
+    FunctionTask(const std::function<void()> &function)
+    :m_function(function)
+    {
+
+    }
+
+    void run() override
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+struct ImageJob
+{
+    QString inputPath;
+    QString outputPath;
+    QImage image;
+};
+
+static void printError(const QString &message)
+{
+    std::fprintf(stderr, "%s\n", qPrintable(message));
+}
+
+static bool parseColorSpace(const QString &name, RgbColorSpace *colorSpace)
+{
+    for (int i = 0; i < ColorSpaceCount; ++i) {
+        if (name.compare(colorSpaceName(RgbColorSpace(i)), Qt::CaseInsensitive) == 0) {
+            *colorSpace = RgbColorSpace(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parsePrecision(const QString &name, ColorTransform::Precision *precision)
+{
+    for (ColorTransform::Precision candidate : { ColorTransform::Lookup, ColorTransform::Approximate,
+                                                 ColorTransform::Exact, ColorTransform::FixedPoint }) {
+        if (name.compare(ColorTransform::precisionName(candidate), Qt::CaseInsensitive) == 0) {
+            *precision = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parseGamutMapping(const QString &name, GamutMapping::Strategy *strategy)
+{
+    const QString strategyNames[] = { "clip", "compress", "soft-knee" };
+    const GamutMapping::Strategy strategies[] = { GamutMapping::Clip, GamutMapping::ChromaCompression,
+                                                  GamutMapping::SoftKnee };
+    for (int i = 0; i < 3; ++i) {
+        if (name.compare(strategyNames[i], Qt::CaseInsensitive) == 0) {
+            *strategy = strategies[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// The image files to convert: the input itself if it is a file, or the
+// files in the input directory which Qt can read.
+static QStringList inputFiles(const QString &input)
+{
+    const QFileInfo info(input);
+    if (!info.isDir())
+        return QStringList() << input;
+
+    QStringList nameFilters;
+    for (const QByteArray &format : QImageReader::supportedImageFormats())
+        nameFilters << QStringLiteral("*.") + QString::fromLatin1(format);
+
+    QStringList files;
+    const QDir directory(input);
+    for (const QString &name : directory.entryList(nameFilters, QDir::Files, QDir::Name))
+        files << directory.filePath(name);
+    return files;
+}
+
+// Tags the converted image with its new color space, so that writers which
+// embed ICC profiles do not keep the profile of the source file. Color
+// spaces Qt has no equivalent for are written untagged.
+static void setImageColorSpace(QImage *image, RgbColorSpace colorSpace)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    switch (colorSpace) {
+    case sRGB:
+        image->setColorSpace(QColorSpace(QColorSpace::SRgb));
+        break;
+    case AdobeRGB:
+        image->setColorSpace(QColorSpace(QColorSpace::AdobeRgb));
+        break;
+    case ProPhotoRGB:
+        image->setColorSpace(QColorSpace(QColorSpace::ProPhotoRgb));
+        break;
+    case Rec2020:
+        image->setColorSpace(QColorSpace(QColorSpace::Bt2020));
+        break;
+    case DisplayP3:
+        image->setColorSpace(QColorSpace(QColorSpace::DisplayP3));
+        break;
+    default:
+        image->setColorSpace(QColorSpace());
+        break;
+    }
+#else
+    Q_UNUSED(image);
+    Q_UNUSED(colorSpace);
+#endif
+}
+
+static QString hexColor(QRgb color)
+{
+    return QString("#%1").arg(color & 0xffffff, 6, 16, QLatin1Char('0'));
+}
+
+// Runs the round trip sweep for each pair, and prints a row per pair.
+// Returns false if any pair has an error above maxError (if not negative).
+static bool validate(const QVector<QPair<RgbColorSpace, RgbColorSpace>> &pairs,
+                     ColorTransform::Precision precision, int threadCount, int maxError)
+{
+    std::printf("%-18s %-18s %5s %8s  %-17s %9s %8s\n", "Source", "Destination", "Max", "Mean",
+                "Worst", "Clipped", "Time");
+    bool passed = true;
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+    for (const QPair<RgbColorSpace, RgbColorSpace> &pair : pairs) {
+        QElapsedTimer timer;
+        timer.start();
+        const RoundTripStatistics statistics =
+            measureRoundTrip(RGBColorSpace(pair.first), RGBColorSpace(pair.second), precision, threadCount);
+        const qint64 milliseconds = timer.elapsed();
+
+        const bool pairPassed = maxError < 0 || statistics.maxError <= maxError;
+        passed &= pairPassed;
+        const QString worst = hexColor(statistics.worstInput) + "->" + hexColor(statistics.worstOutput);
+        std::printf("%-18s %-18s %5d %8.4f  %-17s %8.2f%% %6lld ms%s\n",
+                    qPrintable(colorSpaceName(pair.first)), qPrintable(colorSpaceName(pair.second)),
+                    statistics.maxError, statistics.meanError, qPrintable(worst),
+                    100.0 * statistics.clippedCount / (statistics.colorCount + statistics.clippedCount),
+                    static_cast<long long>(milliseconds), pairPassed ? "" : "  FAIL");
+    }
+    std::printf("%d pairs in %.2f s (%s kernels, %d threads)\n", pairs.count(), totalTimer.elapsed() / 1000.0,
+                qPrintable(simdLevelName(simdLevel())), threadCount);
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("colorconvert-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Converts images between RGB color spaces.\n"
+                                     "Color spaces: " + colorSpaceNames().join(", "));
+    parser.addHelpOption();
+    parser.addPositionalArgument("input", "Image file, or directory of images.");
+    parser.addPositionalArgument("output", "Output directory.");
+    QCommandLineOption fromOption("from", "Source color space (default sRGB).", "space", "sRGB");
+    QCommandLineOption toOption("to", "Destination color space.", "space");
+    QCommandLineOption precisionOption("precision", "lookup, approximate, exact or fixed (default lookup).",
+                                       "precision", "lookup");
+    QCommandLineOption formatOption("format", "Output file format, e.g. png (default: as the input).", "format");
+    QCommandLineOption qualityOption("quality", "Output quality, 0-100 (default: the format default).",
+                                     "quality", "-1");
+    QCommandLineOption threadsOption("threads", "Worker thread count (default: one per core).", "count",
+                                     QString::number(QThread::idealThreadCount()));
+    QCommandLineOption queueOption("queue-depth", "Images queued between pipeline stages (default 2).",
+                                   "count", "2");
+    QCommandLineOption gamutOption("gamut-mapping", "clip, compress or soft-knee (default clip).", "strategy",
+                                   "clip");
+    QCommandLineOption kneeOption("knee", "Soft knee start, as a fraction of the gamut boundary (default 0.8).",
+                                  "fraction", "0.8");
+    QCommandLineOption validateOption("validate", "Round trip all 8-bit colors through each pair of color spaces "
+                                      "(or --from and --to) and print the errors, instead of converting images.");
+    QCommandLineOption maxErrorOption("max-error", "With --validate: fail if a round trip error exceeds this.",
+                                      "steps", "-1");
+    parser.addOptions({ fromOption, toOption, precisionOption, formatOption, qualityOption,
+                        threadsOption, queueOption, gamutOption, kneeOption, validateOption, maxErrorOption });
+    parser.process(app);
+
+    const bool validation = parser.isSet(validateOption);
+    const QStringList arguments = parser.positionalArguments();
+    if (!validation && (arguments.count() != 2 || !parser.isSet(toOption)))
+        parser.showHelp(1);
+
+    RgbColorSpace sourceColorSpace;
+    RgbColorSpace destinationColorSpace = sRGB; // --to is optional with --validate
+    if (!parseColorSpace(parser.value(fromOption), &sourceColorSpace)
+        || (parser.isSet(toOption) && !parseColorSpace(parser.value(toOption), &destinationColorSpace))) {
+        printError("Unknown color space. Available: " + colorSpaceNames().join(", "));
+        return 1;
+    }
+    ColorTransform::Precision precision;
+    if (!parsePrecision(parser.value(precisionOption), &precision)) {
+        printError("Unknown precision: " + parser.value(precisionOption));
+        return 1;
+    }
+    GamutMapping::Strategy gamutMapping;
+    if (!parseGamutMapping(parser.value(gamutOption), &gamutMapping)) {
+        printError("Unknown gamut mapping: " + parser.value(gamutOption));
+        return 1;
+    }
+    const int quality = parser.value(qualityOption).toInt();
+    const int threadCount = qMax(1, parser.value(threadsOption).toInt());
+    const int queueDepth = qMax(1, parser.value(queueOption).toInt());
+
+    if (validation) {
+        QVector<QPair<RgbColorSpace, RgbColorSpace>> pairs;
+        for (int source = 0; source < ColorSpaceCount; ++source) {
+            for (int destination = 0; destination < ColorSpaceCount; ++destination) {
+                if (source == destination)
+                    continue;
+                if (parser.isSet(fromOption) && source != sourceColorSpace)
+                    continue;
+                if (parser.isSet(toOption) && destination != destinationColorSpace)
+                    continue;
+                pairs.append(qMakePair(RgbColorSpace(source), RgbColorSpace(destination)));
+            }
+        }
+        return validate(pairs, precision, threadCount, parser.value(maxErrorOption).toInt()) ? 0 : 1;
+    }
+
+    const QStringList inputs = inputFiles(arguments.at(0));
+    if (inputs.isEmpty()) {
+        printError("No input images in " + arguments.at(0));
+        return 1;
+    }
+    const QDir outputDirectory(arguments.at(1));
+    if (!outputDirectory.mkpath(".")) {
+        printError("Could not create output directory " + arguments.at(1));
+        return 1;
+    }
+    const QString outputFormat = parser.value(formatOption);
+
+    // Output paths keep the input base name. Inputs which differ only in
+    // their suffix (a.png and a.jpg with --format) would be written to the
+    // same file by concurrent encoders, and an output directory which is the
+    // input directory would overwrite the inputs; refuse to start.
+    QSet<QString> canonicalInputs;
+    for (const QString &input : inputs)
+        canonicalInputs.insert(QFileInfo(input).canonicalFilePath());
+    canonicalInputs.remove(QString()); // inputs which do not exist
+    QStringList outputPaths;
+    QHash<QString, QString> inputForOutput;
+    for (const QString &input : inputs) {
+        const QFileInfo info(input);
+        const QString suffix = outputFormat.isEmpty() ? info.suffix() : outputFormat;
+        const QString outputPath = outputDirectory.filePath(info.completeBaseName() + "." + suffix);
+        if (canonicalInputs.contains(QFileInfo(outputPath).canonicalFilePath())) {
+            printError(input + ": the output " + outputPath + " is an input image");
+            return 1;
+        }
+        if (inputForOutput.contains(outputPath)) {
+            printError(inputForOutput.value(outputPath) + " and " + input + " both convert to " + outputPath);
+            return 1;
+        }
+        inputForOutput.insert(outputPath, input);
+        outputPaths.append(outputPath);
+    }
+
+    const QSharedPointer<const ColorTransform> transform =
+        ColorTransform::get(RGBColorSpace(sourceColorSpace), RGBColorSpace(destinationColorSpace),
+                            ColorTransform::PreserveAlpha, precision);
+
+    // Gamut mapping is too slow to evaluate per pixel; bake it into a table,
+    // which costs about as much per pixel as the transform.
+    ColorLut3D gamutMappingLut;
+    if (gamutMapping != GamutMapping::Clip) {
+        const GamutMapping mapping(RGBColorSpace(sourceColorSpace), RGBColorSpace(destinationColorSpace),
+                                   gamutMapping, parser.value(kneeOption).toDouble());
+        gamutMappingLut = ColorLut3D::fromGamutMapping(mapping);
+    }
+
+    BoundedQueue<ImageJob> decoded(queueDepth);
+    BoundedQueue<ImageJob> converted(queueDepth);
+    QAtomicInt nextInput(0);
+    QAtomicInt failureCount(0);
+    QAtomicInt writtenCount(0);
+    QAtomicInteger<qint64> writtenPixels(0);
+
+    // Decoders and encoders get their own pools; the conversion bands run
+    // on the global pool. The stages share the --threads budget: a quarter
+    // each for decoding and encoding, the rest for conversion.
+    const int decoderCount = qMax(1, threadCount / 4);
+    const int encoderCount = qMax(1, threadCount / 4);
+    const int converterCount = qMax(1, threadCount - decoderCount - encoderCount);
+    QThreadPool decodePool;
+    decodePool.setMaxThreadCount(decoderCount);
+    QThreadPool encodePool;
+    encodePool.setMaxThreadCount(encoderCount);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QAtomicInt activeDecoders(decoderCount);
+    for (int i = 0; i < decoderCount; ++i) {
+        decodePool.start(new FunctionTask([&]() {
+            for (int index = nextInput.fetchAndAddRelaxed(1); index < inputs.count();
+                 index = nextInput.fetchAndAddRelaxed(1)) {
+                ImageJob job;
+                job.inputPath = inputs.at(index);
+                QImageReader reader(job.inputPath);
+                const QImage image = reader.read();
+                if (image.isNull()) {
+                    printError(job.inputPath + ": " + reader.errorString());
+                    failureCount.ref();
+                    continue;
+                }
+                // Convert other formats once here, and write them in the
+                // convertible format, instead of converting back and forth
+                job.image = image.convertToFormat(convertibleImageFormat(image));
+                job.outputPath = outputPaths.at(index);
+                decoded.push(std::move(job));
+            }
+            if (!activeDecoders.deref())
+                decoded.close();
+        }));
+    }
+
+    for (int i = 0; i < encoderCount; ++i) {
+        encodePool.start(new FunctionTask([&]() {
+            ImageJob job;
+            while (converted.pop(&job)) {
+                QImageWriter writer(job.outputPath);
+                if (!outputFormat.isEmpty())
+                    writer.setFormat(outputFormat.toLatin1());
+                writer.setQuality(quality);
+                if (!writer.write(job.image)) {
+                    printError(job.outputPath + ": " + writer.errorString());
+                    failureCount.ref();
+                    continue;
+                }
+                writtenCount.ref();
+                writtenPixels.fetchAndAddRelaxed(qint64(job.image.width()) * job.image.height());
+            }
+        }));
+    }
+
+    // Convert on this thread, one image at a time, each in parallel bands.
+    qint64 convertNanoseconds = 0;
+    qint64 convertedPixels = 0;
+    ImageJob job;
+    while (decoded.pop(&job)) {
+        QElapsedTimer convertTimer;
+        convertTimer.start();
+        if (gamutMappingLut.isNull())
+            transform->apply(&job.image, converterCount);
+        else
+            gamutMappingLut.apply(&job.image, converterCount);
+        convertNanoseconds += convertTimer.nsecsElapsed();
+        convertedPixels += qint64(job.image.width()) * job.image.height();
+
+        setImageColorSpace(&job.image, destinationColorSpace);
+        converted.push(std::move(job));
+        job = ImageJob();
+    }
+    converted.close();
+
+    decodePool.waitForDone();
+    encodePool.waitForDone();
+    const qint64 totalNanoseconds = timer.nsecsElapsed();
+
+    const double megapixels = writtenPixels.loadAcquire() / 1e6;
+    const double seconds = totalNanoseconds / 1e9;
+    std::printf("Converted %d of %d images (%.1f MP) from %s to %s in %.2f s: %.1f MP/s\n",
+                writtenCount.loadAcquire(), inputs.count(), megapixels,
+                qPrintable(colorSpaceName(sourceColorSpace)), qPrintable(colorSpaceName(destinationColorSpace)),
+                seconds, seconds > 0 ? megapixels / seconds : 0.0);
+    if (convertNanoseconds > 0) {
+        std::printf("Conversion alone: %.1f MP/s (%s kernels, %d threads)\n",
+                    (convertedPixels / 1e6) / (convertNanoseconds / 1e9),
+                    qPrintable(simdLevelName(simdLevel())), converterCount);
+    }
+
+    return failureCount.loadAcquire() > 0 ? 1 : 0;
+}